@@ -0,0 +1,379 @@
+#include "batch.h"
+#include "compaction.h"
+#include "quantize.h"
+#include "threadpool.h"
+#include "xpmdocument.h"
+#include "xpmreader.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace {
+
+bool has_xpm_extension(const std::string & filename)
+{
+	if(filename.size() < 4) {
+		return false;
+	}
+	std::string extension = filename.substr(filename.size() - 4);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	return extension == ".xpm";
+}
+
+void collect_directory(const std::string & path, std::vector<std::string> & files)
+{
+	DIR * dir = opendir(path.c_str());
+	if(!dir) {
+		return;
+	}
+	std::vector<std::string> names;
+	while(dirent * entry = readdir(dir)) {
+		std::string name = entry->d_name;
+		if(name != "." && name != "..") {
+			names.push_back(name);
+		}
+	}
+	closedir(dir);
+	std::sort(names.begin(), names.end());
+	for(const std::string & name : names) {
+		std::string full_path = path + "/" + name;
+		struct stat info;
+		if(stat(full_path.c_str(), &info) != 0) {
+			continue;
+		}
+		if(S_ISDIR(info.st_mode)) {
+			collect_directory(full_path, files);
+		} else if(S_ISREG(info.st_mode) && has_xpm_extension(name)) {
+			files.push_back(full_path);
+		}
+	}
+}
+
+bool parse_color(std::string text, Chthon::Color & color)
+{
+	if(text == "None" || text == "none" || text == "-") {
+		color = Chthon::Color();
+		return true;
+	}
+	if(text.substr(0, 1) == "#") {
+		text.erase(0, 1);
+	}
+	if(text.empty() || text.find_first_not_of("0123456789ABCDEFabcdef") != std::string::npos) {
+		return false;
+	}
+	if(text.size() == 3) {
+		text = std::string(2, text[0]) + std::string(2, text[1]) + std::string(2, text[2]);
+	}
+	if(text.size() != 6) {
+		return false;
+	}
+	int red = std::stoi(text.substr(0, 2), nullptr, 16);
+	int green = std::stoi(text.substr(2, 2), nullptr, 16);
+	int blue = std::stoi(text.substr(4, 2), nullptr, 16);
+	color = Chthon::from_rgb(red, green, blue);
+	return true;
+}
+
+bool parse_palette(const std::string & spec, std::vector<Chthon::Color> & palette)
+{
+	palette.clear();
+	std::istringstream in(spec);
+	std::string item;
+	while(std::getline(in, item, ',')) {
+		Chthon::Color color;
+		if(!parse_color(item, color)) {
+			return false;
+		}
+		palette.push_back(color);
+	}
+	return !palette.empty();
+}
+
+bool parse_substitution(const std::string & spec, Chthon::Color & from, Chthon::Color & to)
+{
+	size_t separator = spec.find('=');
+	if(separator == std::string::npos) {
+		return false;
+	}
+	return parse_color(spec.substr(0, separator), from) && parse_color(spec.substr(separator + 1), to);
+}
+
+bool parse_size(const std::string & spec, int & width, int & height)
+{
+	size_t separator = spec.find_first_of("xX");
+	if(separator == std::string::npos) {
+		return false;
+	}
+	width = atoi(spec.substr(0, separator).c_str());
+	height = atoi(spec.substr(separator + 1).c_str());
+	return width > 0 && height > 0;
+}
+
+bool parse_quantize(const std::string & spec, int & colors, bool & dither)
+{
+	size_t separator = spec.find(':');
+	colors = atoi(spec.substr(0, separator).c_str());
+	dither = false;
+	if(separator != std::string::npos) {
+		if(spec.substr(separator + 1) != "dither") {
+			return false;
+		}
+		dither = true;
+	}
+	return colors > 0;
+}
+
+bool same_image(const Image & a, const Image & b)
+{
+	if(a.palette != b.palette) {
+		return false;
+	}
+	if(a.pixels.width() != b.pixels.width() || a.pixels.height() != b.pixels.height()) {
+		return false;
+	}
+	int width = a.pixels.width();
+	std::vector<int> row_a(width), row_b(width);
+	for(unsigned y = 0; y < a.pixels.height(); ++y) {
+		a.pixels.readSpan(0, y, width, row_a.data());
+		b.pixels.readSpan(0, y, width, row_b.data());
+		if(row_a != row_b) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void resize(Image & image, int width, int height)
+{
+	TiledCanvas pixels(width, height, 0);
+	pixels.setColorCount(image.palette.size());
+	int copy_width = std::min<int>(width, image.pixels.width());
+	int copy_height = std::min<int>(height, image.pixels.height());
+	std::vector<int> row(copy_width);
+	for(int y = 0; y < copy_height; ++y) {
+		image.pixels.readSpan(0, y, copy_width, row.data());
+		pixels.writeSpan(0, y, copy_width, row.data());
+	}
+	pixels.compact();
+	image.pixels = pixels;
+}
+
+// File must be read identically by Chthon and by own reader, and current image must survive save and load by Chthon.
+std::string verify(const std::string & filename, const Image & image)
+{
+	std::ifstream file(filename.c_str(), std::ios::binary);
+	std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	Chthon::Pixmap reference;
+	reference.load(data);
+	Image expected, parsed;
+	image_from_pixmap(reference, expected);
+	if(parse_xpm(data.data(), data.data() + data.size(), parsed) && !same_image(expected, parsed)) {
+		return "file is read differently by Chthon and by own reader";
+	}
+	Chthon::Pixmap reloaded;
+	reloaded.load(format_xpm(image));
+	Image result;
+	image_from_pixmap(reloaded, result);
+	if(!same_image(image, result)) {
+		return "image changes after save and load";
+	}
+	return std::string();
+}
+
+// Pool is given only when there are no other files to process in parallel.
+std::string process(const std::vector<BatchOperation> & operations, const std::string & filename, ThreadPool * pool)
+{
+	XpmDocument document;
+	Image image;
+	bool modified = false;
+	try {
+		if(!document.load(filename, image)) {
+			return "cannot read file";
+		}
+		for(const BatchOperation & operation : operations) {
+			switch(operation.type) {
+				case BatchOperation::NORMALIZE:
+				{
+					document.resetLayout();
+					modified = true;
+					break;
+				}
+				case BatchOperation::PALETTE:
+				{
+					std::vector<Chthon::Color> palette;
+					parse_palette(operation.argument, palette);
+					size_t count = std::min(palette.size(), image.palette.size());
+					for(size_t i = 0; i < count; ++i) {
+						if(image.palette[i] != palette[i]) {
+							image.palette[i] = palette[i];
+							document.markColor(i);
+							modified = true;
+						}
+					}
+					break;
+				}
+				case BatchOperation::SUBSTITUTE:
+				{
+					Chthon::Color from, to;
+					parse_substitution(operation.argument, from, to);
+					for(size_t i = 0; i < image.palette.size(); ++i) {
+						if(image.palette[i] == from && from != to) {
+							image.palette[i] = to;
+							document.markColor(i);
+							modified = true;
+						}
+					}
+					break;
+				}
+				case BatchOperation::RESIZE:
+				{
+					int width = 0, height = 0;
+					parse_size(operation.argument, width, height);
+					if(unsigned(width) != image.pixels.width() || unsigned(height) != image.pixels.height()) {
+						resize(image, width, height);
+						document.resetLayout();
+						modified = true;
+					}
+					break;
+				}
+				case BatchOperation::COMPACT:
+				{
+					PaletteCompaction compaction;
+					if(compaction.apply(image, pool)) {
+						document.resetLayout();
+						modified = true;
+					}
+					break;
+				}
+				case BatchOperation::QUANTIZE:
+				{
+					int colors = 0;
+					bool dither = false;
+					parse_quantize(operation.argument, colors, dither);
+					Quantizer quantizer;
+					if(quantizer.apply(image, pool, colors, dither)) {
+						document.resetLayout();
+						modified = true;
+					}
+					break;
+				}
+				case BatchOperation::VERIFY:
+				{
+					std::string error = verify(filename, image);
+					if(!error.empty()) {
+						return error;
+					}
+					break;
+				}
+			}
+		}
+	} catch(const Chthon::Pixmap::Exception & e) {
+		return e.what;
+	}
+	if(modified && !document.saveNow(filename, image)) {
+		return "cannot save file";
+	}
+	return std::string();
+}
+
+}
+
+bool check_batch_operations(const std::vector<BatchOperation> & operations)
+{
+	for(const BatchOperation & operation : operations) {
+		bool ok = true;
+		switch(operation.type) {
+			case BatchOperation::PALETTE:
+			{
+				std::vector<Chthon::Color> palette;
+				ok = parse_palette(operation.argument, palette);
+				break;
+			}
+			case BatchOperation::SUBSTITUTE:
+			{
+				Chthon::Color from, to;
+				ok = parse_substitution(operation.argument, from, to);
+				break;
+			}
+			case BatchOperation::RESIZE:
+			{
+				int width = 0, height = 0;
+				ok = parse_size(operation.argument, width, height);
+				break;
+			}
+			case BatchOperation::QUANTIZE:
+			{
+				int colors = 0;
+				bool dither = false;
+				ok = parse_quantize(operation.argument, colors, dither);
+				break;
+			}
+			default: break;
+		}
+		if(!ok) {
+			std::cerr << "Invalid operation argument: " << operation.argument << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+int run_batch(const std::vector<BatchOperation> & operations, const std::vector<std::string> & inputs, unsigned threads)
+{
+	std::vector<std::string> files;
+	std::vector<std::string> errors;
+	for(const std::string & input : inputs) {
+		struct stat info;
+		if(stat(input.c_str(), &info) != 0) {
+			files.push_back(input);
+		} else if(S_ISDIR(info.st_mode)) {
+			collect_directory(input, files);
+		} else {
+			files.push_back(input);
+		}
+	}
+	errors.resize(files.size());
+	std::vector<unsigned long long> sizes(files.size(), 0);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	ThreadPool pool(threads);
+	auto run_file = [&](size_t i) {
+		struct stat info;
+		if(stat(files[i].c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+			errors[i] = "cannot read file";
+			return;
+		}
+		sizes[i] = info.st_size;
+		try {
+			errors[i] = process(operations, files[i], files.size() == 1 ? &pool : 0);
+		} catch(const std::exception & e) {
+			errors[i] = e.what();
+		}
+	};
+	if(files.size() == 1) {
+		run_file(0);
+	} else {
+		pool.run(files.size(), run_file);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	int failed = 0;
+	unsigned long long total_size = 0;
+	for(size_t i = 0; i < files.size(); ++i) {
+		total_size += sizes[i];
+		if(!errors[i].empty()) {
+			std::cerr << files[i] << ": " << errors[i] << std::endl;
+			++failed;
+		}
+	}
+	seconds = std::max(seconds, 1e-6);
+	std::cout << files.size() << " files, " << failed << " failed, "
+		<< pool.size() << " threads, " << seconds << " s, "
+		<< files.size() / seconds << " files/s, "
+		<< total_size / seconds / (1024.0 * 1024.0) << " MB/s" << std::endl;
+	return failed;
+}
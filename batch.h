@@ -0,0 +1,19 @@
+#pragma once
+#include <string>
+#include <vector>
+
+struct BatchOperation {
+	enum Type { NORMALIZE, PALETTE, SUBSTITUTE, RESIZE, COMPACT, QUANTIZE, VERIFY };
+	Type type;
+	std::string argument;
+	BatchOperation(Type operation_type, const std::string & operation_argument = std::string())
+		: type(operation_type), argument(operation_argument) {}
+};
+
+// Checks operation arguments before any file is touched; prints error and returns false if one is invalid.
+bool check_batch_operations(const std::vector<BatchOperation> & operations);
+
+// Applies operations in order to every XPM file from inputs (directories are searched recursively for *.xpm)
+// on a pool of threads (zero means one per hardware thread). Changed files are saved in place.
+// Errors are reported per file, followed by total throughput. Returns number of failed files.
+int run_batch(const std::vector<BatchOperation> & operations, const std::vector<std::string> & inputs, unsigned threads);
@@ -0,0 +1,85 @@
+// Measures palette expansion speed (GB/s of produced ARGB pixels) for several palette sizes
+// with every implementation supported by current CPU, and checks that they give the same results.
+// Usage: expandbench
+#include "../expand.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+
+const int WIDTH = 4096;
+const int HEIGHT = 1024;
+const int RUNS = 5;
+const unsigned PALETTE_SIZES[] = { 2, 4, 16, 64, 256, 4096 };
+const char * PATHS[] = { "scalar", "sse4.1", "avx2" };
+
+typedef std::chrono::steady_clock Clock;
+
+double best_gbps(const std::vector<int> & indices, const std::vector<uint32_t> & palette, std::vector<uint32_t> & pixels)
+{
+	double best = 0;
+	for(int i = 0; i < RUNS; ++i) {
+		Clock::time_point start = Clock::now();
+		expand_palette(&indices[0], WIDTH, &palette[0], palette.size(), &pixels[0], WIDTH, WIDTH, HEIGHT);
+		double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		best = std::max(best, WIDTH * HEIGHT * sizeof(uint32_t) / seconds / 1e9);
+	}
+	return best;
+}
+
+// Odd-sized sub-rectangle, as in dirty region uploads.
+bool check_rect(const std::vector<int> & indices, const std::vector<uint32_t> & palette, const std::vector<uint32_t> & expected)
+{
+	const int x0 = 3, y0 = 5, w = 37, h = 11;
+	std::vector<uint32_t> rect(w * h, 1);
+	expand_palette(&indices[y0 * WIDTH + x0], WIDTH, &palette[0], palette.size(), &rect[0], w, w, h);
+	for(int y = 0; y < h; ++y) {
+		for(int x = 0; x < w; ++x) {
+			if(rect[y * w + x] != expected[(y0 + y) * WIDTH + x0 + x]) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+int main()
+{
+	std::vector<int> indices(WIDTH * HEIGHT);
+	std::vector<uint32_t> expected(WIDTH * HEIGHT), actual(WIDTH * HEIGHT);
+	bool ok = true;
+	for(unsigned palette_size : PALETTE_SIZES) {
+		std::vector<uint32_t> palette(palette_size);
+		for(unsigned i = 0; i < palette_size; ++i) {
+			palette[i] = (i == 0) ? 0 : (0xff000000 | (rand() & 0xffffff));
+		}
+		// Runs of equal indices like in real images, with a few indices outside of palette.
+		for(size_t i = 0; i < indices.size(); ) {
+			int value = (rand() % 100 == 0) ? ((rand() % 2) ? -1 : int(palette_size)) : int(rand() % palette_size);
+			for(size_t end = std::min(indices.size(), i + 1 + rand() % 16); i < end; ++i) {
+				indices[i] = value;
+			}
+		}
+		std::cout << std::setw(5) << palette_size << " colors:" << std::fixed << std::setprecision(2);
+		double scalar = 0;
+		for(const char * path : PATHS) {
+			if(!expand_palette_select(path)) {
+				continue;
+			}
+			std::vector<uint32_t> & pixels = (scalar == 0) ? expected : actual;
+			double gbps = best_gbps(indices, palette, pixels);
+			bool same = (&pixels == &expected || pixels == expected) && check_rect(indices, palette, expected);
+			ok = ok && same;
+			std::cout << " " << path << " " << gbps << " GB/s";
+			if(scalar == 0) {
+				scalar = gbps;
+			} else {
+				std::cout << " (" << gbps / scalar << "x)";
+			}
+			std::cout << (same ? "" : " RESULTS DIFFER") << ";";
+		}
+		std::cout << std::endl;
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,184 @@
+// Compares FloodFill with Chthon::Map::floodfill on worst-case 4096x4096 patterns.
+// Chthon fill runs in child process, as it may run out of stack on long narrow areas.
+// Usage: fillbench
+#include "../floodfill.h"
+#include <chthon2/map.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+const int SIZE = 4096;
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsed_ms(const Clock::time_point & start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+Chthon::Map<int> uniform()
+{
+	return Chthon::Map<int>(SIZE, SIZE, 0);
+}
+
+// One pixel wide corridor winding from the border to the center.
+Chthon::Map<int> spiral()
+{
+	Chthon::Map<int> map(SIZE, SIZE, 1);
+	const int dx[] = { 1, 0, -1, 0 };
+	const int dy[] = { 0, 1, 0, -1 };
+	int x = 0, y = 0;
+	map.cell(x, y) = 0;
+	int length = SIZE - 1;
+	for(int leg = 0; length > 0; ++leg) {
+		for(int i = 0; i < length; ++i) {
+			x += dx[leg % 4];
+			y += dy[leg % 4];
+			map.cell(x, y) = 0;
+		}
+		// Legs go as L, L, L, L-2, L-2, L-4, L-4...
+		if(leg >= 2 && leg % 2 == 0) {
+			length -= 2;
+		}
+	}
+	return map;
+}
+
+// Vertical corridors joined alternately at top and bottom.
+Chthon::Map<int> serpentine()
+{
+	Chthon::Map<int> map(SIZE, SIZE, 1);
+	for(int x = 0; x < SIZE; x += 2) {
+		for(int y = 0; y < SIZE; ++y) {
+			map.cell(x, y) = 0;
+		}
+		if(x + 2 < SIZE) {
+			map.cell(x + 1, (x / 2) % 2 ? 0 : SIZE - 1) = 0;
+		}
+	}
+	return map;
+}
+
+// Cells are connected only diagonally.
+Chthon::Map<int> checkerboard()
+{
+	Chthon::Map<int> map(SIZE, SIZE, 0);
+	for(int y = 0; y < SIZE; ++y) {
+		for(int x = 0; x < SIZE; ++x) {
+			map.cell(x, y) = (x + y) % 2;
+		}
+	}
+	return map;
+}
+
+long long count_value(const Chthon::Map<int> & map, int value)
+{
+	long long count = 0;
+	for(int y = 0; y < SIZE; ++y) {
+		for(int x = 0; x < SIZE; ++x) {
+			count += map.cell(x, y) == value;
+		}
+	}
+	return count;
+}
+
+long long count_value(const TiledCanvas & canvas, int value)
+{
+	std::vector<int> row(SIZE);
+	long long count = 0;
+	for(int y = 0; y < SIZE; ++y) {
+		canvas.readSpan(0, y, SIZE, row.data());
+		count += std::count(row.begin(), row.end(), value);
+	}
+	return count;
+}
+
+TiledCanvas to_canvas(const Chthon::Map<int> & map)
+{
+	TiledCanvas canvas(SIZE, SIZE);
+	for(int y = 0; y < SIZE; ++y) {
+		canvas.writeSpan(0, y, SIZE, &map.cell(0, y));
+	}
+	canvas.compact();
+	return canvas;
+}
+
+// Returns time in ms or negative value if fill has crashed.
+double chthon_fill(Chthon::Map<int> map, long long & filled)
+{
+	int fds[2];
+	if(pipe(fds) != 0) {
+		return -1;
+	}
+	pid_t pid = fork();
+	if(pid == 0) {
+		close(fds[0]);
+		Clock::time_point start = Clock::now();
+		map.floodfill(0, 0, 2);
+		double result[2] = { elapsed_ms(start), double(count_value(map, 2)) };
+		ssize_t written = write(fds[1], result, sizeof(result));
+		_exit(written == sizeof(result) ? 0 : 1);
+	}
+	close(fds[1]);
+	double result[2] = { -1, 0 };
+	ssize_t size = read(fds[0], result, sizeof(result));
+	close(fds[0]);
+	int status = 0;
+	waitpid(pid, &status, 0);
+	if(size != sizeof(result) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		return -1;
+	}
+	filled = (long long)result[1];
+	return result[0];
+}
+
+int main()
+{
+	struct Pattern {
+		const char * name;
+		Chthon::Map<int> (*make)();
+		bool eight_connected;
+	};
+	const Pattern patterns[] = {
+		{ "uniform", uniform, false },
+		{ "spiral", spiral, false },
+		{ "serpentine", serpentine, false },
+		{ "checkerboard", checkerboard, false },
+		{ "checkerboard/8", checkerboard, true },
+	};
+	bool ok = true;
+	FloodFill fill;
+	for(const Pattern & pattern : patterns) {
+		Chthon::Map<int> map = pattern.make();
+		TiledCanvas canvas = to_canvas(map);
+		std::cout << std::setw(15) << pattern.name << ": " << std::fixed << std::setprecision(2);
+		if(!pattern.eight_connected) {
+			long long expected = 0;
+			double time = chthon_fill(map, expected);
+			if(time < 0) {
+				std::cout << "Chthon floodfill crashed, ";
+			} else {
+				std::cout << "Chthon floodfill " << time << " ms, ";
+			}
+			Clock::time_point start = Clock::now();
+			fill.apply(canvas, Chthon::Point(0, 0), 2, false);
+			double own = elapsed_ms(start);
+			long long filled = count_value(canvas, 2);
+			bool same = time < 0 || filled == expected;
+			ok = ok && same;
+			std::cout << "FloodFill " << own << " ms, " << filled << " pixels, " << fill.filledSpans().size() << " spans"
+				<< (same ? "" : ", RESULTS DIFFER") << std::endl;
+		} else {
+			Clock::time_point start = Clock::now();
+			fill.apply(canvas, Chthon::Point(0, 0), 2, true);
+			double own = elapsed_ms(start);
+			std::cout << "FloodFill " << own << " ms, " << count_value(canvas, 2) << " pixels, " << fill.filledSpans().size() << " spans" << std::endl;
+		}
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+// Compares load time of XPM files through Chthon::Pixmap::load and load_xpm.
+// Usage: loadbench FILE.xpm...
+#include "../xpmreader.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+
+const int RUNS = 3;
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsed_ms(const Clock::time_point & start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void load_through_chthon(const std::string & filename, Chthon::Pixmap & pixmap)
+{
+	std::ifstream file(filename.c_str());
+	std::string data((std::istreambuf_iterator<char>(file)),
+			std::istreambuf_iterator<char>());
+	pixmap.load(data);
+}
+
+bool same_images(const Image & a, const Image & b)
+{
+	if(a.palette != b.palette || a.pixels.width() != b.pixels.width() || a.pixels.height() != b.pixels.height()) {
+		return false;
+	}
+	int width = a.pixels.width();
+	std::vector<int> row_a(width), row_b(width);
+	for(unsigned y = 0; y < a.pixels.height(); ++y) {
+		a.pixels.readSpan(0, y, width, row_a.data());
+		b.pixels.readSpan(0, y, width, row_b.data());
+		if(row_a != row_b) {
+			return false;
+		}
+	}
+	return true;
+}
+
+template<class Loader, class Result>
+double best_time(Loader loader, const std::string & filename, Result & pixmap)
+{
+	double best = 0;
+	for(int i = 0; i < RUNS; ++i) {
+		Result result;
+		Clock::time_point start = Clock::now();
+		loader(filename, result);
+		double time = elapsed_ms(start);
+		if(i == 0 || time < best) {
+			best = time;
+		}
+		if(i == RUNS - 1) {
+			pixmap = result;
+		}
+	}
+	return best;
+}
+
+int main(int argc, char ** argv)
+{
+	if(argc < 2) {
+		std::cerr << "Usage: loadbench FILE.xpm..." << std::endl;
+		return 1;
+	}
+	bool ok = true;
+	for(int i = 1; i < argc; ++i) {
+		std::string filename = argv[i];
+		try {
+			Chthon::Pixmap reference;
+			Image expected, actual;
+			double chthon_time = best_time(load_through_chthon, filename, reference);
+			double mmap_time = best_time(load_xpm, filename, actual);
+			image_from_pixmap(reference, expected);
+			bool same = same_images(expected, actual);
+			ok = ok && same;
+			std::cout << filename << ": "
+				<< std::fixed << std::setprecision(2)
+				<< "Chthon::Pixmap::load " << chthon_time << " ms, "
+				<< "load_xpm " << mmap_time << " ms (" << actual.pixels.memoryUsage() / 1024 << " KB), "
+				<< "speedup " << (mmap_time > 0 ? chthon_time / mmap_time : 0) << "x"
+				<< (same ? "" : ", RESULTS DIFFER") << std::endl;
+		} catch(const Chthon::Pixmap::Exception & e) {
+			std::cerr << filename << ": " << e.what << std::endl;
+			ok = false;
+		}
+	}
+	return ok ? 0 : 1;
+}
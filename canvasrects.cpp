@@ -0,0 +1,54 @@
+#include "canvasrects.h"
+#include "profile.h"
+
+void CanvasRects::draw(SDL_Renderer * renderer, const Image & canvas, const Damage &, const SDL_Rect & visible, const Chthon::Point & leftTop, int zoom)
+{
+	if(!renderer || visible.w <= 0 || visible.h <= 0) {
+		return;
+	}
+	checkerboard.draw(renderer, visible, leftTop, zoom);
+
+	size_t palette_size = canvas.palette.size();
+	if(buckets.size() < palette_size) {
+		buckets.resize(palette_size);
+	}
+	opaque.resize(palette_size);
+	for(size_t i = 0; i < palette_size; ++i) {
+		buckets[i].clear();
+		opaque[i] = !Chthon::is_transparent(canvas.palette[i]);
+	}
+
+	int right = visible.x + visible.w;
+	row.resize(visible.w);
+	for(int y = visible.y; y < visible.y + visible.h; ++y) {
+		canvas.pixels.readSpan(visible.x, y, visible.w, row.data());
+		int x = visible.x;
+		while(x < right) {
+			unsigned index = row[x - visible.x];
+			int run_end = x + 1;
+			while(run_end < right && unsigned(row[run_end - visible.x]) == index) {
+				++run_end;
+			}
+			if(index < palette_size && opaque[index]) {
+				SDL_Rect r;
+				r.x = leftTop.x + x * zoom;
+				r.y = leftTop.y + y * zoom;
+				r.w = (run_end - x) * zoom;
+				r.h = zoom;
+				buckets[index].push_back(r);
+			}
+			x = run_end;
+		}
+	}
+
+	for(size_t i = 0; i < palette_size; ++i) {
+		if(buckets[i].empty()) {
+			continue;
+		}
+		Chthon::Color color = canvas.palette[i];
+		SDL_SetRenderDrawColor(renderer, Chthon::get_red(color), Chthon::get_green(color), Chthon::get_blue(color), 255);
+		Profile::count(Profile::DRAW_COLOR_CHANGES);
+		SDL_RenderFillRects(renderer, &buckets[i][0], buckets[i].size());
+		Profile::count(Profile::FILL_RECTS);
+	}
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include "canvasview.h"
+#include "checkerboard.h"
+#include <vector>
+
+class CanvasRects : public CanvasView {
+public:
+	virtual const char * name() const { return "rects"; }
+	virtual void draw(SDL_Renderer * renderer, const Image & canvas, const Damage & damage, const SDL_Rect & visible, const Chthon::Point & leftTop, int zoom);
+private:
+	Checkerboard checkerboard;
+	std::vector<std::vector<SDL_Rect> > buckets;
+	std::vector<bool> opaque;
+	std::vector<int> row;
+};
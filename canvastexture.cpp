@@ -0,0 +1,95 @@
+#include "canvastexture.h"
+#include "expand.h"
+#include "profile.h"
+#include <algorithm>
+
+const int TEXTURE_GRANULARITY = 256;
+
+Uint32 to_argb(const Chthon::Color & color)
+{
+	if(Chthon::is_transparent(color)) {
+		return 0;
+	}
+	return 0xff000000
+		| (Uint32(Chthon::get_red(color)) << 16)
+		| (Uint32(Chthon::get_green(color)) << 8)
+		| Uint32(Chthon::get_blue(color));
+}
+
+bool same_rect(const SDL_Rect & a, const SDL_Rect & b)
+{
+	return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+}
+
+void CanvasTexture::upload(const Image & canvas, const SDL_Rect & rect)
+{
+	SDL_Rect r;
+	if(!SDL_IntersectRect(&rect, &window, &r)) {
+		return;
+	}
+
+	SDL_Rect texture_rect = r;
+	texture_rect.x -= window.x;
+	texture_rect.y -= window.y;
+	void * pixels = 0;
+	int pitch = 0;
+	if(SDL_LockTexture(texture, &texture_rect, &pixels, &pitch) != 0) {
+		return;
+	}
+	indices.resize(r.w * r.h);
+	for(int y = 0; y < r.h; ++y) {
+		canvas.pixels.readSpan(r.x, r.y + y, r.w, &indices[y * r.w]);
+	}
+	expand_palette(indices.data(), r.w, palette.data(), palette.size(),
+			(Uint32*)pixels, pitch / sizeof(Uint32), r.w, r.h);
+	SDL_UnlockTexture(texture);
+}
+
+void CanvasTexture::draw(SDL_Renderer * renderer, const Image & canvas, const Damage & damage, const SDL_Rect & visible, const Chthon::Point & leftTop, int zoom)
+{
+	if(!renderer || visible.w <= 0 || visible.h <= 0) {
+		return;
+	}
+	bool reupload = false;
+	if(!texture || visible.w > capacity_w || visible.h > capacity_h) {
+		if(texture) {
+			SDL_DestroyTexture(texture);
+		}
+		capacity_w = (visible.w / TEXTURE_GRANULARITY + 1) * TEXTURE_GRANULARITY;
+		capacity_h = (visible.h / TEXTURE_GRANULARITY + 1) * TEXTURE_GRANULARITY;
+		texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, capacity_w, capacity_h);
+		SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+		reupload = true;
+	}
+	if(!same_rect(window, visible)) {
+		window = visible;
+		reupload = true;
+	}
+
+	if(reupload || !damage.empty()) {
+		palette.resize(canvas.palette.size());
+		std::transform(canvas.palette.begin(), canvas.palette.end(), palette.begin(), to_argb);
+	}
+	if(reupload || damage.isFull()) {
+		upload(canvas, window);
+	} else {
+		for(const SDL_Rect & rect : damage.rects()) {
+			upload(canvas, rect);
+		}
+	}
+
+	SDL_Rect src;
+	src.x = 0;
+	src.y = 0;
+	src.w = window.w;
+	src.h = window.h;
+	SDL_Rect dest;
+	dest.x = leftTop.x + window.x * zoom;
+	dest.y = leftTop.y + window.y * zoom;
+	dest.w = window.w * zoom;
+	dest.h = window.h * zoom;
+
+	checkerboard.draw(renderer, window, leftTop, zoom);
+	SDL_RenderCopy(renderer, texture, &src, &dest);
+	Profile::count(Profile::RENDER_COPIES);
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "canvasview.h"
+#include "checkerboard.h"
+#include <vector>
+
+class CanvasTexture : public CanvasView {
+public:
+	CanvasTexture() : texture(0), capacity_w(0), capacity_h(0) { window.x = window.y = window.w = window.h = 0; }
+	virtual const char * name() const { return "texture"; }
+	virtual void draw(SDL_Renderer * renderer, const Image & canvas, const Damage & damage, const SDL_Rect & visible, const Chthon::Point & leftTop, int zoom);
+private:
+	SDL_Texture * texture;
+	Checkerboard checkerboard;
+	int capacity_w, capacity_h;
+	SDL_Rect window;
+	std::vector<Uint32> palette;
+	std::vector<int> indices;
+
+	void upload(const Image & canvas, const SDL_Rect & rect);
+};
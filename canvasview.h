@@ -0,0 +1,12 @@
+#pragma once
+#include "damage.h"
+#include "image.h"
+#include <chthon2/point.h>
+#include <SDL2/SDL.h>
+
+class CanvasView {
+public:
+	virtual ~CanvasView() {}
+	virtual const char * name() const = 0;
+	virtual void draw(SDL_Renderer * renderer, const Image & canvas, const Damage & damage, const SDL_Rect & visible, const Chthon::Point & leftTop, int zoom) = 0;
+};
@@ -0,0 +1,49 @@
+#include "checkerboard.h"
+#include "profile.h"
+#include <algorithm>
+#include <vector>
+
+const int CHECKER_SIZE = 256;
+
+SDL_Texture * create_checker_texture(SDL_Renderer * renderer)
+{
+	std::vector<Uint32> pixels(CHECKER_SIZE * CHECKER_SIZE);
+	for(int y = 0; y < CHECKER_SIZE; ++y) {
+		for(int x = 0; x < CHECKER_SIZE; ++x) {
+			pixels[x + y * CHECKER_SIZE] = ((x + y) % 2 == 0) ? 0xff000000 : 0xff202020;
+		}
+	}
+	SDL_Texture * result = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, CHECKER_SIZE, CHECKER_SIZE);
+	SDL_UpdateTexture(result, 0, &pixels[0], CHECKER_SIZE * sizeof(Uint32));
+	return result;
+}
+
+void Checkerboard::draw(SDL_Renderer * renderer, const SDL_Rect & visible, const Chthon::Point & leftTop, int zoom)
+{
+	if(!texture) {
+		texture = create_checker_texture(renderer);
+	}
+	// Odd zoom factors get one checker cell per pixel, even ones get four.
+	int cell = (zoom % 2 != 0) ? zoom : zoom / 2;
+	int parity = ((visible.x + visible.y) * (zoom / cell)) % 2;
+	// Tile step is kept even so that the pattern parity is preserved between tiles.
+	int tile_cells = CHECKER_SIZE - 2;
+	int cells_w = visible.w * zoom / cell;
+	int cells_h = visible.h * zoom / cell;
+	for(int y = 0; y < cells_h; y += tile_cells) {
+		for(int x = 0; x < cells_w; x += tile_cells) {
+			SDL_Rect src;
+			src.x = parity;
+			src.y = 0;
+			src.w = std::min(tile_cells, cells_w - x);
+			src.h = std::min(tile_cells, cells_h - y);
+			SDL_Rect dest;
+			dest.x = leftTop.x + visible.x * zoom + x * cell;
+			dest.y = leftTop.y + visible.y * zoom + y * cell;
+			dest.w = src.w * cell;
+			dest.h = src.h * cell;
+			SDL_RenderCopy(renderer, texture, &src, &dest);
+			Profile::count(Profile::RENDER_COPIES);
+		}
+	}
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include <chthon2/point.h>
+#include <SDL2/SDL.h>
+
+class Checkerboard {
+public:
+	Checkerboard() : texture(0) {}
+	void draw(SDL_Renderer * renderer, const SDL_Rect & visible, const Chthon::Point & leftTop, int zoom);
+private:
+	SDL_Texture * texture;
+};
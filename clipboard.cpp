@@ -0,0 +1,127 @@
+#include "clipboard.h"
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+void copy_skipping(const int * source, int * destination, int count, int skip)
+{
+	int x = 0;
+#ifdef __SSE2__
+	const __m128i key = _mm_set1_epi32(skip);
+	for(; x + 4 <= count; x += 4) {
+		__m128i value = _mm_loadu_si128((const __m128i*)(source + x));
+		__m128i old = _mm_loadu_si128((const __m128i*)(destination + x));
+		__m128i keep = _mm_cmpeq_epi32(value, key);
+		__m128i result = _mm_or_si128(_mm_and_si128(keep, old), _mm_andnot_si128(keep, value));
+		_mm_storeu_si128((__m128i*)(destination + x), result);
+	}
+#endif
+	for(; x < count; ++x) {
+		if(source[x] != skip) {
+			destination[x] = source[x];
+		}
+	}
+}
+
+bool Clipboard::isRegister(char name)
+{
+	return name == UNNAMED || (name >= 'a' && name <= 'z');
+}
+
+Clipboard::Register * Clipboard::find(char name)
+{
+	if(name == UNNAMED) {
+		return &registers[26];
+	}
+	if(name >= 'a' && name <= 'z') {
+		return &registers[name - 'a'];
+	}
+	return 0;
+}
+
+const Clipboard::Register * Clipboard::find(char name) const
+{
+	return const_cast<Clipboard*>(this)->find(name);
+}
+
+bool Clipboard::has(char name) const
+{
+	const Register * reg = find(name);
+	return reg && reg->width > 0 && reg->height > 0;
+}
+
+int Clipboard::width(char name) const
+{
+	const Register * reg = find(name);
+	return reg ? reg->width : 0;
+}
+
+int Clipboard::height(char name) const
+{
+	const Register * reg = find(name);
+	return reg ? reg->height : 0;
+}
+
+SDL_Rect clip_rect(const SDL_Rect & rect, int width, int height)
+{
+	SDL_Rect result;
+	result.x = std::max(0, rect.x);
+	result.y = std::max(0, rect.y);
+	result.w = std::min(width, rect.x + rect.w) - result.x;
+	result.h = std::min(height, rect.y + rect.h) - result.y;
+	if(result.w <= 0 || result.h <= 0) {
+		result.w = result.h = 0;
+	}
+	return result;
+}
+
+bool Clipboard::copy(char name, const TiledCanvas & pixels, const SDL_Rect & rect, int row_limit)
+{
+	Register * reg = find(name);
+	if(!reg) {
+		return false;
+	}
+	SDL_Rect r = clip_rect(rect, pixels.width(), std::min<int>(pixels.height(), row_limit));
+	if(r.w <= 0) {
+		return false;
+	}
+	reg->width = r.w;
+	reg->height = r.h;
+	reg->pixels.resize(r.w * r.h);
+	for(int y = 0; y < r.h; ++y) {
+		pixels.readSpan(r.x, r.y + y, r.w, &reg->pixels[y * r.w]);
+	}
+	return true;
+}
+
+SDL_Rect Clipboard::paste(char name, TiledCanvas & pixels, int x, int y, int row_limit, int skip_index)
+{
+	SDL_Rect target;
+	target.x = x;
+	target.y = y;
+	target.w = target.h = 0;
+	const Register * reg = find(name);
+	if(!reg || reg->width <= 0) {
+		return target;
+	}
+	target.w = reg->width;
+	target.h = reg->height;
+	SDL_Rect r = clip_rect(target, pixels.width(), std::min<int>(pixels.height(), row_limit));
+	if(r.w <= 0) {
+		return r;
+	}
+	previous.resize(r.w * r.h);
+	for(int row_index = 0; row_index < r.h; ++row_index) {
+		int * old = &previous[row_index * r.w];
+		const int * source = &reg->pixels[(r.y - y + row_index) * reg->width + (r.x - x)];
+		pixels.readSpan(r.x, r.y + row_index, r.w, old);
+		if(skip_index >= 0) {
+			row.assign(old, old + r.w);
+			copy_skipping(source, row.data(), r.w, skip_index);
+			source = row.data();
+		}
+		pixels.writeSpan(r.x, r.y + row_index, r.w, source);
+	}
+	return r;
+}
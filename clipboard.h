@@ -0,0 +1,38 @@
+#pragma once
+#include "tiledcanvas.h"
+#include <SDL2/SDL.h>
+#include <vector>
+
+// Blocks of pixels copied from canvas, kept in vim-like named registers ('a'-'z' and unnamed '"').
+// Register buffers and buffers of replaced pixels are reused, so repeated copy and paste do not allocate.
+class Clipboard {
+public:
+	static const char UNNAMED = '"';
+	static bool isRegister(char name);
+	// Copies rectangle (clipped to canvas and to rows above row_limit) into register.
+	bool copy(char name, const TiledCanvas & pixels, const SDL_Rect & rect, int row_limit);
+	bool has(char name) const;
+	int width(char name) const;
+	int height(char name) const;
+	// Pastes register with its top-left corner at (x, y), clipped to canvas and to rows above row_limit.
+	// When skip_index is not negative, pixels of that index in the block leave canvas unchanged.
+	// Returns changed rectangle (empty if nothing was pasted); values it had before are available through previousPixels().
+	SDL_Rect paste(char name, TiledCanvas & pixels, int x, int y, int row_limit, int skip_index = -1);
+	// Pixels of the last pasted rectangle before paste, row by row.
+	const std::vector<int> & previousPixels() const { return previous; }
+private:
+	struct Register {
+		int width, height;
+		std::vector<int> pixels;
+		Register() : width(0), height(0) {}
+	};
+	Register registers[27];
+	std::vector<int> previous;
+	std::vector<int> row;
+
+	Register * find(char name);
+	const Register * find(char name) const;
+};
+
+// Copies count values, leaving destination unchanged where source equals skip.
+void copy_skipping(const int * source, int * destination, int count, int skip);
@@ -0,0 +1,73 @@
+#include "codetable.h"
+
+CodeTable::CodeTable(int chars_per_pixel)
+	: cpp(chars_per_pixel)
+{
+	if(cpp <= 2) {
+		flat.resize(cpp == 1 ? 0x100 : 0x10000, -1);
+	}
+}
+
+uint64_t CodeTable::key(const char * code) const
+{
+	uint64_t result = 0;
+	for(int i = 0; i < cpp; ++i) {
+		result = (result << 8) | (unsigned char)code[i];
+	}
+	return result;
+}
+
+bool CodeTable::add(const char * code, int index)
+{
+	if(find(code) >= 0) {
+		return false;
+	}
+	if(cpp <= 2) {
+		flat[key(code)] = index;
+	} else {
+		wide[key(code)] = index;
+	}
+	return true;
+}
+
+int CodeTable::find(const char * code) const
+{
+	if(cpp == 1) {
+		return flat[(unsigned char)code[0]];
+	} else if(cpp == 2) {
+		return flat[((unsigned char)code[0] << 8) | (unsigned char)code[1]];
+	}
+	std::unordered_map<uint64_t, int>::const_iterator it = wide.find(key(code));
+	return it == wide.end() ? -1 : it->second;
+}
+
+bool CodeTable::decode(const char * codes, int count, int * values) const
+{
+	if(cpp == 1) {
+		for(int i = 0; i < count; ++i) {
+			int index = flat[(unsigned char)codes[i]];
+			if(index < 0) {
+				return false;
+			}
+			values[i] = index;
+		}
+		return true;
+	} else if(cpp == 2) {
+		for(int i = 0; i < count; ++i, codes += 2) {
+			int index = flat[((unsigned char)codes[0] << 8) | (unsigned char)codes[1]];
+			if(index < 0) {
+				return false;
+			}
+			values[i] = index;
+		}
+		return true;
+	}
+	for(int i = 0; i < count; ++i, codes += cpp) {
+		int index = find(codes);
+		if(index < 0) {
+			return false;
+		}
+		values[i] = index;
+	}
+	return true;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+// Maps XPM pixel codes to palette indices: flat table for 1 and 2 chars per pixel, hash of packed chars for wider codes (up to 8).
+class CodeTable {
+public:
+	CodeTable(int chars_per_pixel);
+	bool add(const char * code, int index);
+	int find(const char * code) const;
+	// Decodes count consecutive codes; returns false on unknown code.
+	bool decode(const char * codes, int count, int * values) const;
+private:
+	int cpp;
+	std::vector<int> flat;
+	std::unordered_map<uint64_t, int> wide;
+
+	uint64_t key(const char * code) const;
+};
@@ -0,0 +1,52 @@
+#include "compaction.h"
+#include <algorithm>
+#include <map>
+
+bool PaletteCompaction::apply(Image & image, ThreadPool * pool, int keep)
+{
+	size_t colors = image.palette.size();
+	std::vector<unsigned> histogram = count_indices(image.pixels, colors, pool);
+	if(keep >= 0 && size_t(keep) < colors) {
+		histogram[keep] = std::max(histogram[keep], 1u);
+	}
+
+	// All transparent colors look the same, so they are merged too.
+	std::map<Chthon::Color, int> first_entry;
+	std::vector<Chthon::Color> palette;
+	bool identity = true;
+	table.assign(colors, -1);
+	for(size_t index = 0; index < colors; ++index) {
+		if(histogram[index] == 0) {
+			continue;
+		}
+		Chthon::Color color = image.palette[index];
+		if(Chthon::is_transparent(color)) {
+			color = Chthon::Color();
+		}
+		std::map<Chthon::Color, int>::const_iterator entry = first_entry.find(color);
+		if(entry != first_entry.end()) {
+			table[index] = entry->second;
+		} else {
+			table[index] = palette.size();
+			first_entry[color] = palette.size();
+			palette.push_back(image.palette[index]);
+		}
+		if(table[index] != int(index)) {
+			identity = false;
+		}
+	}
+	if(identity && palette.size() == colors) {
+		return false;
+	}
+
+	if(identity) {
+		pixels = IndexRemap();
+	} else {
+		pixels.apply(image.pixels, table, colors, false, pool);
+	}
+	old_palette.swap(image.palette);
+	image.palette.swap(palette);
+	image.pixels.setColorCount(image.palette.size());
+	image.pixels.compact();
+	return true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "image.h"
+#include "remap.h"
+#include <SDL2/SDL.h>
+#include <vector>
+
+class ThreadPool;
+
+// Drops unused palette entries and merges entries of the same color, rewriting pixel indices through remap table.
+// Histogram of used indices and rewriting of pixels are split into bands of rows processed on thread pool.
+// Surviving entries keep their relative order; duplicates are merged into the first entry of that color.
+class PaletteCompaction {
+public:
+	PaletteCompaction() {}
+	// Entry `keep` is not dropped even if it is unused (e.g. current color); negative means none.
+	// Without pool bands are processed on the calling thread.
+	// Returns false and leaves image intact if there is nothing to compact.
+	bool apply(Image & image, ThreadPool * pool, int keep = -1);
+	// Old index -> new index for the last apply(); dropped entries are mapped to -1.
+	const std::vector<int> & remap() const { return table; }
+	// Palette before the last apply().
+	const std::vector<Chthon::Color> & previousPalette() const { return old_palette; }
+	const std::vector<IndexRemap::Span> & changedSpans() const { return pixels.changedSpans(); }
+	const std::vector<SDL_Rect> & changedRects() const { return pixels.changedRects(); }
+private:
+	std::vector<int> table;
+	std::vector<Chthon::Color> old_palette;
+	IndexRemap pixels;
+};
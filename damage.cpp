@@ -0,0 +1,74 @@
+#include "damage.h"
+#include <algorithm>
+
+const size_t MAX_REGIONS = 32;
+
+bool rects_touch(const SDL_Rect & a, const SDL_Rect & b)
+{
+	return a.x <= b.x + b.w && b.x <= a.x + a.w && a.y <= b.y + b.h && b.y <= a.y + a.h;
+}
+
+SDL_Rect rects_union(const SDL_Rect & a, const SDL_Rect & b)
+{
+	SDL_Rect result;
+	result.x = std::min(a.x, b.x);
+	result.y = std::min(a.y, b.y);
+	result.w = std::max(a.x + a.w, b.x + b.w) - result.x;
+	result.h = std::max(a.y + a.h, b.y + b.h) - result.y;
+	return result;
+}
+
+void Damage::add(const SDL_Rect & rect)
+{
+	if(full || rect.w <= 0 || rect.h <= 0) {
+		return;
+	}
+	SDL_Rect merged = rect;
+	bool changed = true;
+	while(changed) {
+		changed = false;
+		for(size_t i = 0; i < regions.size(); ++i) {
+			if(rects_touch(merged, regions[i])) {
+				merged = rects_union(merged, regions[i]);
+				regions.erase(regions.begin() + i);
+				changed = true;
+				break;
+			}
+		}
+	}
+	regions.push_back(merged);
+	if(regions.size() > MAX_REGIONS) {
+		SDL_Rect bounds = regions[0];
+		for(size_t i = 1; i < regions.size(); ++i) {
+			bounds = rects_union(bounds, regions[i]);
+		}
+		regions.assign(1, bounds);
+	}
+}
+
+void Damage::add(int x, int y, int w, int h)
+{
+	SDL_Rect rect;
+	rect.x = x;
+	rect.y = y;
+	rect.w = w;
+	rect.h = h;
+	add(rect);
+}
+
+void Damage::addAll()
+{
+	full = true;
+	regions.clear();
+}
+
+void Damage::clear()
+{
+	full = false;
+	regions.clear();
+}
+
+bool Damage::empty() const
+{
+	return !full && regions.empty();
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <vector>
+
+class Damage {
+public:
+	Damage() : full(false) {}
+	void add(const SDL_Rect & rect);
+	void add(int x, int y, int w = 1, int h = 1);
+	void addAll();
+	void clear();
+	bool empty() const;
+	bool isFull() const { return full; }
+	const std::vector<SDL_Rect> & rects() const { return regions; }
+private:
+	bool full;
+	std::vector<SDL_Rect> regions;
+};
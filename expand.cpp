@@ -0,0 +1,146 @@
+#include "expand.h"
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define EXPAND_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+enum ExpandPath { EXPAND_SCALAR, EXPAND_SSE41, EXPAND_AVX2 };
+
+ExpandPath detect_path()
+{
+#ifdef EXPAND_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")) {
+		return EXPAND_AVX2;
+	}
+	if(__builtin_cpu_supports("sse4.1")) {
+		return EXPAND_SSE41;
+	}
+#endif
+	return EXPAND_SCALAR;
+}
+
+const ExpandPath cpu_path = detect_path();
+ExpandPath path = cpu_path;
+const char * PATH_NAMES[] = { "scalar", "sse4.1", "avx2" };
+
+void expand_row_scalar(const int * indices, const uint32_t * palette, unsigned palette_size, uint32_t * pixels, int width)
+{
+	for(int x = 0; x < width; ++x) {
+		unsigned index = indices[x];
+		pixels[x] = index < palette_size ? palette[index] : 0;
+	}
+}
+
+void expand_scalar(const int * indices, int index_pitch, const uint32_t * palette, unsigned palette_size,
+		uint32_t * pixels, int pixel_pitch, int width, int height)
+{
+	for(int y = 0; y < height; ++y) {
+		expand_row_scalar(indices + y * index_pitch, palette, palette_size, pixels + y * pixel_pitch, width);
+	}
+}
+
+#ifdef EXPAND_X86
+
+// Each of 16 indices is turned into byte (0x80 for indices outside of palette, so shuffle gives zero for it),
+// then every channel is looked up in its own 16-byte table and channels are interleaved back.
+__attribute__((target("sse4.1")))
+void expand_sse41(const int * indices, int index_pitch, const uint32_t * palette, unsigned palette_size,
+		uint32_t * pixels, int pixel_pitch, int width, int height)
+{
+	alignas(16) uint8_t planes[4][16] = {};
+	for(unsigned i = 0; i < palette_size; ++i) {
+		for(int channel = 0; channel < 4; ++channel) {
+			planes[channel][i] = (palette[i] >> (channel * 8)) & 0xff;
+		}
+	}
+	const __m128i blue = _mm_load_si128((const __m128i*)planes[0]);
+	const __m128i green = _mm_load_si128((const __m128i*)planes[1]);
+	const __m128i red = _mm_load_si128((const __m128i*)planes[2]);
+	const __m128i alpha = _mm_load_si128((const __m128i*)planes[3]);
+	const __m128i limit = _mm_set1_epi32(palette_size - 1);
+	const __m128i invalid = _mm_set1_epi32(0x80);
+	for(int y = 0; y < height; ++y, indices += index_pitch, pixels += pixel_pitch) {
+		int x = 0;
+		for(; x + 16 <= width; x += 16) {
+			__m128i quads[4];
+			for(int i = 0; i < 4; ++i) {
+				__m128i value = _mm_loadu_si128((const __m128i*)(indices + x + i * 4));
+				__m128i valid = _mm_cmpeq_epi32(_mm_min_epu32(value, limit), value);
+				quads[i] = _mm_blendv_epi8(invalid, value, valid);
+			}
+			__m128i bytes = _mm_packus_epi16(_mm_packs_epi32(quads[0], quads[1]), _mm_packs_epi32(quads[2], quads[3]));
+			__m128i b = _mm_shuffle_epi8(blue, bytes);
+			__m128i g = _mm_shuffle_epi8(green, bytes);
+			__m128i r = _mm_shuffle_epi8(red, bytes);
+			__m128i a = _mm_shuffle_epi8(alpha, bytes);
+			__m128i bg_low = _mm_unpacklo_epi8(b, g);
+			__m128i ra_low = _mm_unpacklo_epi8(r, a);
+			__m128i bg_high = _mm_unpackhi_epi8(b, g);
+			__m128i ra_high = _mm_unpackhi_epi8(r, a);
+			_mm_storeu_si128((__m128i*)(pixels + x), _mm_unpacklo_epi16(bg_low, ra_low));
+			_mm_storeu_si128((__m128i*)(pixels + x + 4), _mm_unpackhi_epi16(bg_low, ra_low));
+			_mm_storeu_si128((__m128i*)(pixels + x + 8), _mm_unpacklo_epi16(bg_high, ra_high));
+			_mm_storeu_si128((__m128i*)(pixels + x + 12), _mm_unpackhi_epi16(bg_high, ra_high));
+		}
+		expand_row_scalar(indices + x, palette, palette_size, pixels + x, width - x);
+	}
+}
+
+__attribute__((target("avx2")))
+void expand_avx2(const int * indices, int index_pitch, const uint32_t * palette, unsigned palette_size,
+		uint32_t * pixels, int pixel_pitch, int width, int height)
+{
+	const __m256i limit = _mm256_set1_epi32(palette_size - 1);
+	for(int y = 0; y < height; ++y, indices += index_pitch, pixels += pixel_pitch) {
+		int x = 0;
+		for(; x + 8 <= width; x += 8) {
+			__m256i value = _mm256_loadu_si256((const __m256i*)(indices + x));
+			__m256i valid = _mm256_cmpeq_epi32(_mm256_min_epu32(value, limit), value);
+			__m256i result = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int*)palette, value, valid, 4);
+			_mm256_storeu_si256((__m256i*)(pixels + x), result);
+		}
+		expand_row_scalar(indices + x, palette, palette_size, pixels + x, width - x);
+	}
+}
+
+#endif
+
+}
+
+void expand_palette(const int * indices, int index_pitch, const uint32_t * palette, unsigned palette_size,
+		uint32_t * pixels, int pixel_pitch, int width, int height)
+{
+#ifdef EXPAND_X86
+	if(palette_size > 0) {
+		if(path == EXPAND_AVX2) {
+			expand_avx2(indices, index_pitch, palette, palette_size, pixels, pixel_pitch, width, height);
+			return;
+		} else if(path == EXPAND_SSE41 && palette_size <= 16) {
+			expand_sse41(indices, index_pitch, palette, palette_size, pixels, pixel_pitch, width, height);
+			return;
+		}
+	}
+#endif
+	expand_scalar(indices, index_pitch, palette, palette_size, pixels, pixel_pitch, width, height);
+}
+
+const char * expand_palette_path()
+{
+	return PATH_NAMES[path];
+}
+
+bool expand_palette_select(const char * name)
+{
+	for(int i = EXPAND_SCALAR; i <= cpu_path; ++i) {
+		if(strcmp(PATH_NAMES[i], name) == 0) {
+			path = ExpandPath(i);
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <cstdint>
+
+// Converts rectangle of palette indices into ARGB8888 pixels through palette; indices outside of palette become transparent (0).
+// Pitches are in items, so sub-rectangle is converted by passing pointers to its top-left corner.
+// Uses AVX2 gathers or SSE4.1 shuffles (for palettes up to 16 colors) when CPU supports them, scalar code otherwise.
+void expand_palette(const int * indices, int index_pitch, const uint32_t * palette, unsigned palette_size,
+		uint32_t * pixels, int pixel_pitch, int width, int height);
+
+// Name of implementation in use: "avx2", "sse4.1" or "scalar".
+const char * expand_palette_path();
+
+// Switches to given implementation (for benchmarks and comparison of results); returns false if CPU does not support it.
+bool expand_palette_select(const char * path);
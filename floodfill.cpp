@@ -0,0 +1,80 @@
+#include "floodfill.h"
+#include <algorithm>
+
+// Tiles filled completely are turned back into single values as fill goes, so filling large areas does not unpack them all.
+const size_t COMPACT_SPANS = 4096;
+
+// Segment is a run [left, right] filled on row y - dy; row y is to be scanned for pixels adjacent to it.
+// Filled pixels do not match target value anymore, so image itself serves as visited set.
+SDL_Rect FloodFill::apply(TiledCanvas & pixels, const Chthon::Point & start, int value, bool eight_connected)
+{
+	SDL_Rect changed;
+	changed.x = changed.y = changed.w = changed.h = 0;
+	spans.clear();
+	stack.clear();
+	if(!pixels.valid(start.x, start.y) || pixels.get(start.x, start.y) == value) {
+		return changed;
+	}
+	int target = pixels.get(start.x, start.y);
+	int width = pixels.width();
+	int height = pixels.height();
+	int diagonal = eight_connected ? 1 : 0;
+	int left = start.x, top = start.y, right = start.x, bottom = start.y;
+
+	// Start pixel is scanned as if it was filled from below; the row below is seeded separately.
+	Segment below = { start.y + 1, start.x, start.x, 1 };
+	stack.push_back(below);
+	Segment seed = { start.y, start.x, start.x, -1 };
+	stack.push_back(seed);
+	while(!stack.empty()) {
+		Segment segment = stack.back();
+		stack.pop_back();
+		int y = segment.y;
+		if(y < 0 || y >= height) {
+			continue;
+		}
+		int scan_begin = std::max(0, segment.left - diagonal);
+		int scan_end = std::min(width - 1, segment.right + diagonal);
+		int x = scan_begin;
+		while(true) {
+			x = pixels.scanRight(x, y, scan_end + 1, target, true);
+			if(x > scan_end) {
+				break;
+			}
+			int run_left = pixels.scanLeft(x, y, -1, target, false) + 1;
+			int run_right = pixels.scanRight(x, y, width, target, false) - 1;
+			pixels.fillSpan(run_left, y, run_right - run_left + 1, value);
+			Span span = { run_left, y, run_right - run_left + 1 };
+			spans.push_back(span);
+			if(spans.size() % COMPACT_SPANS == 0) {
+				pixels.compact();
+			}
+			left = std::min(left, run_left);
+			right = std::max(right, run_right);
+			top = std::min(top, y);
+			bottom = std::max(bottom, y);
+
+			Segment next = { y + segment.dy, run_left, run_right, segment.dy };
+			stack.push_back(next);
+			// Parts of run that stick out of parent segment may touch unfilled pixels on parent row.
+			if(run_left < segment.left) {
+				Segment back = { y - segment.dy, run_left, segment.left - 1, -segment.dy };
+				stack.push_back(back);
+			}
+			if(run_right > segment.right) {
+				Segment back = { y - segment.dy, segment.right + 1, run_right, -segment.dy };
+				stack.push_back(back);
+			}
+			x = run_right + 2;
+		}
+	}
+	if(spans.empty()) {
+		return changed;
+	}
+	pixels.compact();
+	changed.x = left;
+	changed.y = top;
+	changed.w = right - left + 1;
+	changed.h = bottom - top + 1;
+	return changed;
+}
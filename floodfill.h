@@ -0,0 +1,26 @@
+#pragma once
+#include "tiledcanvas.h"
+#include <chthon2/point.h>
+#include <SDL2/SDL.h>
+#include <vector>
+
+// Scanline flood fill: whole horizontal runs are filled at once and only segments of neighbour rows to scan are kept on explicit stack,
+// so memory use depends on shape complexity rather than on area. Runs are searched tile by tile, so uniform tiles are skipped at once.
+class FloodFill {
+public:
+	struct Span {
+		int x, y, length;
+	};
+	FloodFill() {}
+	// Fills area of the same value around start with given value.
+	// Returns bounding box of changed pixels (empty if nothing was changed).
+	SDL_Rect apply(TiledCanvas & pixels, const Chthon::Point & start, int value, bool eight_connected);
+	// Spans filled by the last apply().
+	const std::vector<Span> & filledSpans() const { return spans; }
+private:
+	struct Segment {
+		int y, left, right, dy;
+	};
+	std::vector<Segment> stack;
+	std::vector<Span> spans;
+};
@@ -0,0 +1,31 @@
+#include "framestats.h"
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+double percentile(const std::vector<double> & sorted, double fraction)
+{
+	size_t index = size_t(fraction * (sorted.size() - 1) + 0.5);
+	return sorted[std::min(index, sorted.size() - 1)];
+}
+
+void FrameStats::report(std::ostream & out, const std::string & title, double total_time) const
+{
+	out << title << ": " << times.size() << " frames, total " << std::fixed << std::setprecision(2) << total_time << " ms";
+	if(times.empty()) {
+		out << std::endl;
+		return;
+	}
+	std::vector<double> sorted = times;
+	std::sort(sorted.begin(), sorted.end());
+	double sum = 0;
+	for(double time : sorted) {
+		sum += time;
+	}
+	out << ", per frame: avg " << sum / sorted.size()
+		<< " p50 " << percentile(sorted, 0.5)
+		<< " p90 " << percentile(sorted, 0.9)
+		<< " p99 " << percentile(sorted, 0.99)
+		<< " max " << sorted.back()
+		<< " ms" << std::endl;
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+class FrameStats {
+public:
+	void add(double milliseconds) { times.push_back(milliseconds); }
+	size_t count() const { return times.size(); }
+	void report(std::ostream & out, const std::string & title, double total_time) const;
+private:
+	std::vector<double> times;
+};
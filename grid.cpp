@@ -0,0 +1,101 @@
+#include "grid.h"
+#include "profile.h"
+#include <algorithm>
+#include <vector>
+
+const int GRID_TILE_SIZE = 256;
+const size_t GRID_CACHED_ZOOMS = 4;
+
+Uint32 dot_color(int size, int pos)
+{
+	return ((size + pos) % 2 == 0) ? 0xff000000 : 0xffffffff;
+}
+
+SDL_Texture * create_texture(SDL_Renderer * renderer, int width, int height, const std::vector<Uint32> & pixels)
+{
+	SDL_Texture * result = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, width, height);
+	SDL_UpdateTexture(result, 0, &pixels[0], width * sizeof(Uint32));
+	SDL_SetTextureBlendMode(result, SDL_BLENDMODE_BLEND);
+	return result;
+}
+
+SDL_Texture * create_dotted_texture(SDL_Renderer * renderer, int size, bool is_h)
+{
+	std::vector<Uint32> pixels(size);
+	for(int x = 0; x < size; ++x) {
+		pixels[x] = dot_color(size, x);
+	}
+	return create_texture(renderer, is_h ? size : 1, is_h ? 1 : size, pixels);
+}
+
+SDL_Texture * create_grid_tile(SDL_Renderer * renderer, int size, int cells)
+{
+	int tile_size = size * cells;
+	std::vector<Uint32> pixels(tile_size * tile_size, 0);
+	for(int y = 0; y < tile_size; ++y) {
+		for(int x = 0; x < tile_size; ++x) {
+			if(y % size == 0) {
+				pixels[x + y * tile_size] = dot_color(size, x % size);
+			} else if(x % size == 0) {
+				pixels[x + y * tile_size] = dot_color(size, y % size);
+			}
+		}
+	}
+	return create_texture(renderer, tile_size, tile_size, pixels);
+}
+
+const Grid::Textures & Grid::get(SDL_Renderer * renderer, int zoom)
+{
+	for(std::list<Textures>::iterator it = cache.begin(); it != cache.end(); ++it) {
+		if(it->zoom == zoom) {
+			cache.splice(cache.begin(), cache, it);
+			return cache.front();
+		}
+	}
+	if(cache.size() >= GRID_CACHED_ZOOMS) {
+		const Textures & oldest = cache.back();
+		SDL_DestroyTexture(oldest.tile);
+		SDL_DestroyTexture(oldest.dot_h);
+		SDL_DestroyTexture(oldest.dot_v);
+		cache.pop_back();
+	}
+	Textures textures;
+	textures.zoom = zoom;
+	textures.cells = std::max(1, GRID_TILE_SIZE / zoom);
+	textures.tile = create_grid_tile(renderer, zoom, textures.cells);
+	textures.dot_h = create_dotted_texture(renderer, zoom, true);
+	textures.dot_v = create_dotted_texture(renderer, zoom, false);
+	cache.push_front(textures);
+	return cache.front();
+}
+
+SDL_Texture * Grid::getHorizontalDots(SDL_Renderer * renderer, int zoom)
+{
+	return get(renderer, zoom).dot_h;
+}
+
+SDL_Texture * Grid::getVerticalDots(SDL_Renderer * renderer, int zoom)
+{
+	return get(renderer, zoom).dot_v;
+}
+
+void Grid::draw(SDL_Renderer * renderer, const Chthon::Point & leftTop, const SDL_Rect & visible, int zoom)
+{
+	const Textures & textures = get(renderer, zoom);
+	for(int y = 0; y < visible.h; y += textures.cells) {
+		for(int x = 0; x < visible.w; x += textures.cells) {
+			SDL_Rect src;
+			src.x = 0;
+			src.y = 0;
+			src.w = std::min(textures.cells, visible.w - x) * zoom;
+			src.h = std::min(textures.cells, visible.h - y) * zoom;
+			SDL_Rect dest;
+			dest.x = leftTop.x + (visible.x + x) * zoom;
+			dest.y = leftTop.y + (visible.y + y) * zoom;
+			dest.w = src.w;
+			dest.h = src.h;
+			SDL_RenderCopy(renderer, textures.tile, &src, &dest);
+			Profile::count(Profile::RENDER_COPIES);
+		}
+	}
+}
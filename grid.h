@@ -0,0 +1,23 @@
+#pragma once
+#include <chthon2/point.h>
+#include <SDL2/SDL.h>
+#include <list>
+
+// Textures are cached for a few most recently used zoom levels; the least recently used one is dropped.
+class Grid {
+public:
+	void draw(SDL_Renderer * renderer, const Chthon::Point & leftTop, const SDL_Rect & visible, int zoom);
+	SDL_Texture * getHorizontalDots(SDL_Renderer * renderer, int zoom);
+	SDL_Texture * getVerticalDots(SDL_Renderer * renderer, int zoom);
+private:
+	struct Textures {
+		int zoom;
+		SDL_Texture * tile;
+		SDL_Texture * dot_h;
+		SDL_Texture * dot_v;
+		int cells;
+	};
+	std::list<Textures> cache; // Most recently used first.
+
+	const Textures & get(SDL_Renderer * renderer, int zoom);
+};
@@ -0,0 +1,192 @@
+#include "history.h"
+#include <algorithm>
+
+History::History(size_t history_budget)
+	: budget(history_budget), used(0), position(0)
+{
+}
+
+void History::setBudget(size_t bytes)
+{
+	budget = bytes;
+	evict();
+}
+
+size_t History::Action::memoryUsage() const
+{
+	return sizeof(Action)
+		+ spans.capacity() * sizeof(SpanRecord)
+		+ runs.capacity() * sizeof(int)
+		+ colors.capacity() * sizeof(ColorRecord);
+}
+
+namespace {
+
+unsigned append_runs(std::vector<int> & runs, const int * values, int length)
+{
+	unsigned offset = runs.size();
+	int x = 0;
+	while(x < length) {
+		int end = x + 1;
+		while(end < length && values[end] == values[x]) {
+			++end;
+		}
+		runs.push_back(end - x);
+		runs.push_back(values[x]);
+		x = end;
+	}
+	return offset;
+}
+
+void write_runs(const std::vector<int> & runs, unsigned offset, int length, TiledCanvas & pixels, int x, int y)
+{
+	int end = x + length;
+	while(x < end) {
+		int count = runs[offset];
+		pixels.fillSpan(x, y, count, runs[offset + 1]);
+		x += count;
+		offset += 2;
+	}
+}
+
+}
+
+void History::addSpan(int x, int y, int length, const int * before, const int * after)
+{
+	if(length <= 0) {
+		return;
+	}
+	SpanRecord span = { x, y, length, 0, 0 };
+	span.before = append_runs(pending.runs, before, length);
+	span.after = append_runs(pending.runs, after, length);
+	pending.spans.push_back(span);
+}
+
+void History::addFill(int x, int y, int length, int before, int after)
+{
+	if(length <= 0) {
+		return;
+	}
+	SpanRecord span = { x, y, length, unsigned(pending.runs.size()), unsigned(pending.runs.size() + 2) };
+	pending.runs.push_back(length);
+	pending.runs.push_back(before);
+	pending.runs.push_back(length);
+	pending.runs.push_back(after);
+	pending.spans.push_back(span);
+}
+
+void History::addColor(unsigned index, const Chthon::Color & before, const Chthon::Color & after)
+{
+	ColorRecord color = { index, before, after };
+	pending.colors.push_back(color);
+}
+
+void History::addPaletteResize(unsigned before, unsigned after)
+{
+	if(!pending.resizes_palette) {
+		pending.palette_before = before;
+		pending.resizes_palette = true;
+	}
+	pending.palette_after = after;
+}
+
+void History::commit()
+{
+	if(!hasPending()) {
+		return;
+	}
+	dropRedo();
+	pending.spans.shrink_to_fit();
+	pending.runs.shrink_to_fit();
+	pending.colors.shrink_to_fit();
+	actions.push_back(Action());
+	std::swap(actions.back(), pending);
+	used += actions.back().memoryUsage();
+	position = actions.size();
+	evict();
+}
+
+void History::dropRedo()
+{
+	while(actions.size() > position) {
+		used -= actions.back().memoryUsage();
+		actions.pop_back();
+	}
+}
+
+void History::evict()
+{
+	while(!actions.empty() && used > budget) {
+		used -= actions.front().memoryUsage();
+		actions.pop_front();
+		if(position > 0) {
+			--position;
+		}
+	}
+}
+
+bool History::undo(Image & image)
+{
+	commit();
+	if(position == 0) {
+		return false;
+	}
+	--position;
+	apply(actions[position], false, image);
+	return true;
+}
+
+bool History::redo(Image & image)
+{
+	if(!canRedo()) {
+		return false;
+	}
+	apply(actions[position], true, image);
+	++position;
+	return true;
+}
+
+// Undo goes through records backwards, so changes of the same pixel within one action are reverted in the right order.
+void History::apply(const Action & action, bool forward, Image & image)
+{
+	change.spans.clear();
+	change.colors.clear();
+	change.palette_resized = action.resizes_palette;
+	int left = 0, top = 0, right = -1, bottom = -1;
+	size_t count = action.spans.size();
+	for(size_t i = 0; i < count; ++i) {
+		const SpanRecord & span = action.spans[forward ? i : count - 1 - i];
+		if(!image.pixels.valid(span.x, span.y) || !image.pixels.valid(span.x + span.length - 1, span.y)) {
+			continue;
+		}
+		write_runs(action.runs, forward ? span.after : span.before, span.length, image.pixels, span.x, span.y);
+		Span changed = { span.x, span.y, span.length };
+		change.spans.push_back(changed);
+		if(right < left) {
+			left = span.x;
+			right = span.x + span.length - 1;
+			top = bottom = span.y;
+		} else {
+			left = std::min(left, span.x);
+			right = std::max(right, span.x + span.length - 1);
+			top = std::min(top, span.y);
+			bottom = std::max(bottom, span.y);
+		}
+	}
+	change.bounds.x = left;
+	change.bounds.y = top;
+	change.bounds.w = right - left + 1;
+	change.bounds.h = bottom - top + 1;
+
+	if(action.resizes_palette) {
+		image.palette.resize(forward ? action.palette_after : action.palette_before);
+	}
+	count = action.colors.size();
+	for(size_t i = 0; i < count; ++i) {
+		const ColorRecord & color = action.colors[forward ? i : count - 1 - i];
+		if(color.index < image.palette.size()) {
+			image.palette[color.index] = forward ? color.after : color.before;
+			change.colors.push_back(color.index);
+		}
+	}
+}
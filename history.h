@@ -0,0 +1,71 @@
+#pragma once
+#include "image.h"
+#include <chthon2/pixmap.h>
+#include <SDL2/SDL.h>
+#include <deque>
+#include <vector>
+
+// Undo/redo history.
+// Action keeps only spans of pixels it has changed, with run-length encoded values before and after the change,
+// and changed palette entries, so its size depends on the change rather than on the image.
+// Oldest actions are dropped when history does not fit into memory budget.
+class History {
+public:
+	struct Span {
+		int x, y, length;
+	};
+	// Result of last undo() or redo().
+	struct Change {
+		SDL_Rect bounds; // Empty when no pixels were changed.
+		std::vector<Span> spans;
+		std::vector<unsigned> colors;
+		bool palette_resized;
+	};
+
+	static const size_t DEFAULT_BUDGET = 64 << 20;
+	explicit History(size_t budget = DEFAULT_BUDGET);
+	void setBudget(size_t bytes);
+	size_t memoryUsage() const { return used; }
+
+	// Changes are collected into pending action until commit().
+	void addSpan(int x, int y, int length, const int * before, const int * after);
+	void addFill(int x, int y, int length, int before, int after);
+	void addColor(unsigned index, const Chthon::Color & before, const Chthon::Color & after);
+	void addPaletteResize(unsigned before, unsigned after);
+	void commit();
+
+	bool canUndo() const { return position > 0 || hasPending(); }
+	bool canRedo() const { return position < actions.size() && !hasPending(); }
+	bool undo(Image & image);
+	bool redo(Image & image);
+	const Change & lastChange() const { return change; }
+private:
+	struct SpanRecord {
+		int x, y, length;
+		unsigned before, after; // Offsets of value runs (pairs of run length and value).
+	};
+	struct ColorRecord {
+		unsigned index;
+		Chthon::Color before, after;
+	};
+	struct Action {
+		std::vector<SpanRecord> spans;
+		std::vector<int> runs;
+		std::vector<ColorRecord> colors;
+		unsigned palette_before, palette_after;
+		bool resizes_palette;
+		Action() : palette_before(0), palette_after(0), resizes_palette(false) {}
+		size_t memoryUsage() const;
+	};
+	size_t budget;
+	size_t used;
+	std::deque<Action> actions;
+	size_t position;
+	Action pending;
+	Change change;
+
+	bool hasPending() const { return !pending.spans.empty() || !pending.colors.empty() || pending.resizes_palette; }
+	void apply(const Action & action, bool forward, Image & image);
+	void dropRedo();
+	void evict();
+};
@@ -0,0 +1,157 @@
+#include "hud.h"
+#include "profile.h"
+#include <algorithm>
+
+const int PALETTE_ENTRY_WIDTH = 32;
+const int PALETTE_ENTRY_HEIGHT = 16;
+
+void set_draw_color(SDL_Renderer * renderer, const Chthon::Color & color)
+{
+	SDL_SetRenderDrawColor(renderer, Chthon::get_red(color), Chthon::get_green(color), Chthon::get_blue(color), 255);
+	Profile::count(Profile::DRAW_COLOR_CHANGES);
+}
+
+void Hud::invalidate()
+{
+	valid = false;
+}
+
+void Hud::scrollPalette(int entries)
+{
+	scroll += entries;
+	valid = false;
+	follow_selection = false;
+}
+
+void Hud::render(SDL_Renderer * renderer, const Font & font, int width, int height)
+{
+	int visible_entries = std::max(1, height / PALETTE_ENTRY_HEIGHT);
+	int last_entry = std::min(int(palette.size()), scroll + visible_entries + 1);
+
+	SDL_Rect palette_rect;
+	palette_rect.x = 0;
+	palette_rect.y = 0;
+	palette_rect.w = PALETTE_ENTRY_WIDTH;
+	palette_rect.h = PALETTE_ENTRY_HEIGHT;
+	for(int i = scroll; i < last_entry; ++i) {
+		palette_rect.y = (i - scroll) * PALETTE_ENTRY_HEIGHT;
+		set_draw_color(renderer, palette[i]);
+		SDL_RenderFillRect(renderer, &palette_rect);
+		Profile::count(Profile::FILL_RECTS);
+	}
+	SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+	Profile::count(Profile::DRAW_COLOR_CHANGES);
+	palette_rect.y = 0;
+	palette_rect.h = PALETTE_ENTRY_HEIGHT * (last_entry - scroll);
+	SDL_RenderDrawRect(renderer, &palette_rect);
+
+	if(color < palette.size()) {
+		SDL_Rect currentColorRect;
+		currentColorRect.x = 0;
+		currentColorRect.y = (int(color) - scroll) * PALETTE_ENTRY_HEIGHT;
+		currentColorRect.w = 32;
+		currentColorRect.h = 16;
+		set_draw_color(renderer, palette[color]);
+		SDL_RenderFillRect(renderer, &currentColorRect);
+		Profile::count(Profile::FILL_RECTS);
+		SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+		Profile::count(Profile::DRAW_COLOR_CHANGES);
+		SDL_RenderDrawRect(renderer, &currentColorRect);
+
+		SDL_Rect colorUnderCursorRect;
+		colorUnderCursorRect.x = 24;
+		colorUnderCursorRect.y = currentColorRect.y + 8;
+		colorUnderCursorRect.w = 8;
+		colorUnderCursorRect.h = 8;
+		set_draw_color(renderer, under_cursor);
+		SDL_RenderFillRect(renderer, &colorUnderCursorRect);
+		Profile::count(Profile::FILL_RECTS);
+		SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+		Profile::count(Profile::DRAW_COLOR_CHANGES);
+		SDL_RenderDrawRect(renderer, &colorUnderCursorRect);
+	}
+
+	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+	Profile::count(Profile::DRAW_COLOR_CHANGES);
+	SDL_Rect text_rect;
+	text_rect.x = 33;
+	text_rect.y = 0;
+	text_rect.w = width - 33;
+	text_rect.h = 16;
+	SDL_RenderFillRect(renderer, &text_rect);
+	Profile::count(Profile::FILL_RECTS);
+
+	SDL_Rect dest_rect;
+	dest_rect.x = 33;
+	dest_rect.y = 2;
+	dest_rect.w = font.getCharRect(0).w;
+	dest_rect.h = font.getCharRect(0).h;
+	for(const char & ch : status) {
+		if(dest_rect.x >= width) {
+			break;
+		}
+		SDL_Rect char_rect = font.getCharRect(ch);
+		SDL_RenderCopy(renderer, font.getFont(), &char_rect, &dest_rect);
+		Profile::count(Profile::RENDER_COPIES);
+		dest_rect.x += dest_rect.w;
+	}
+}
+
+void Hud::draw(SDL_Renderer * renderer, const Font & font, const std::vector<Chthon::Color> & new_palette, unsigned new_color, const Chthon::Color & new_under_cursor, const std::string & new_status, int width, int height)
+{
+	int visible_entries = std::max(1, height / PALETTE_ENTRY_HEIGHT);
+	if(new_color != color || new_palette != palette) {
+		follow_selection = true;
+	}
+	if(follow_selection) {
+		if(int(new_color) < scroll) {
+			scroll = new_color;
+		} else if(int(new_color) >= scroll + visible_entries) {
+			scroll = new_color - visible_entries + 1;
+		}
+	}
+	scroll = std::max(0, std::min(scroll, int(new_palette.size()) - visible_entries));
+
+	bool changed = !valid
+		|| texture_w != width || texture_h != height
+		|| scroll != rendered_scroll
+		|| new_color != color
+		|| new_under_cursor != under_cursor
+		|| new_status != status
+		|| new_palette != palette;
+	if(changed) {
+		palette = new_palette;
+		color = new_color;
+		under_cursor = new_under_cursor;
+		status = new_status;
+		rendered_scroll = scroll;
+	}
+
+	if(!texture || texture_w != width || texture_h != height) {
+		if(texture) {
+			SDL_DestroyTexture(texture);
+		}
+		texture_w = width;
+		texture_h = height;
+		texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, width, height);
+		if(texture) {
+			SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+		}
+	}
+	if(!texture) {
+		render(renderer, font, width, height);
+		return;
+	}
+	if(changed) {
+		SDL_Texture * old_target = SDL_GetRenderTarget(renderer);
+		SDL_SetRenderTarget(renderer, texture);
+		SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+		Profile::count(Profile::DRAW_COLOR_CHANGES);
+		SDL_RenderClear(renderer);
+		render(renderer, font, width, height);
+		SDL_SetRenderTarget(renderer, old_target);
+		valid = true;
+	}
+	SDL_RenderCopy(renderer, texture, 0, 0);
+	Profile::count(Profile::RENDER_COPIES);
+}
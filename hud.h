@@ -0,0 +1,27 @@
+#pragma once
+#include "font.h"
+#include <chthon2/pixmap.h>
+#include <SDL2/SDL.h>
+#include <string>
+#include <vector>
+
+class Hud {
+public:
+	Hud() : texture(0), texture_w(0), texture_h(0), scroll(0), valid(false), follow_selection(true), color(0), under_cursor(0), rendered_scroll(0) {}
+	void invalidate();
+	void scrollPalette(int entries);
+	void draw(SDL_Renderer * renderer, const Font & font, const std::vector<Chthon::Color> & palette, unsigned color, const Chthon::Color & under_cursor, const std::string & status, int width, int height);
+private:
+	SDL_Texture * texture;
+	int texture_w, texture_h;
+	int scroll;
+	bool valid; // False when texture has to be rendered anew.
+	bool follow_selection; // Palette strip is scrolled to current color; dropped by wheel scrolling.
+	std::vector<Chthon::Color> palette;
+	unsigned color;
+	Chthon::Color under_cursor;
+	std::string status;
+	int rendered_scroll;
+
+	void render(SDL_Renderer * renderer, const Font & font, int width, int height);
+};
@@ -0,0 +1,22 @@
+#include "image.h"
+
+void image_from_pixmap(const Chthon::Pixmap & pixmap, Image & image)
+{
+	image.palette = pixmap.palette;
+	image.pixels = TiledCanvas(pixmap.pixels.width(), pixmap.pixels.height());
+	image.pixels.setColorCount(pixmap.palette.size());
+	for(unsigned y = 0; y < pixmap.pixels.height(); ++y) {
+		// Map keeps cells row by row.
+		image.pixels.writeSpan(0, y, pixmap.pixels.width(), &pixmap.pixels.cell(0, y));
+	}
+	image.pixels.compact();
+}
+
+void image_to_pixmap(const Image & image, Chthon::Pixmap & pixmap)
+{
+	pixmap.palette = image.palette;
+	pixmap.pixels = Chthon::Map<int>(image.pixels.width(), image.pixels.height());
+	for(unsigned y = 0; y < image.pixels.height(); ++y) {
+		image.pixels.readSpan(0, y, image.pixels.width(), &pixmap.pixels.cell(0, y));
+	}
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include "tiledcanvas.h"
+#include <chthon2/pixmap.h>
+#include <vector>
+
+// Edited image: palette and tiled pixel indices into it.
+// Chthon::Pixmap is used only where files are read by Chthon itself or compared with its results.
+struct Image {
+	std::vector<Chthon::Color> palette;
+	TiledCanvas pixels;
+	explicit Image(unsigned width = 1, unsigned height = 1, const Chthon::Color & color = Chthon::Color())
+		: palette(1, color), pixels(width, height) {}
+};
+
+void image_from_pixmap(const Chthon::Pixmap & pixmap, Image & image);
+void image_to_pixmap(const Image & image, Chthon::Pixmap & pixmap);
@@ -0,0 +1,273 @@
+#include "journal.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Records use native byte order: journal is never moved to another machine.
+const char JOURNAL_MAGIC[4] = { 'P', 'X', 'J', '1' };
+const size_t JOURNAL_HEADER_SIZE = sizeof(JOURNAL_MAGIC) + 2 * sizeof(int32_t);
+const int JOURNAL_FLUSH_INTERVAL_MS = 200;
+const size_t JOURNAL_FLUSH_SIZE = 1 << 20;
+
+enum JournalRecord { SPAN_RECORD = 1, FILL_RECORD = 2, COLOR_RECORD = 3, PALETTE_SIZE_RECORD = 4 };
+
+Journal::Journal()
+	: fd(-1), record_count(0), truncate_pending(false), stopping(false)
+{
+}
+
+Journal::~Journal()
+{
+	close();
+}
+
+bool Journal::open(const std::string & journal_filename, int width, int height, bool keep_records)
+{
+	close();
+	filename = journal_filename;
+	fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | (keep_records ? 0 : O_TRUNC), 0644);
+	if(fd < 0) {
+		return false;
+	}
+	record_count = 0;
+	truncate_pending = false;
+	stopping = false;
+	buffer.clear();
+	struct stat st;
+	if(!keep_records || fstat(fd, &st) != 0 || st.st_size == 0) {
+		int32_t size[2] = { width, height };
+		append(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+		append(size, sizeof(size));
+	}
+	writer = std::thread(&Journal::run, this);
+	return true;
+}
+
+void Journal::close()
+{
+	if(fd < 0) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	changed.notify_all();
+	writer.join();
+	::close(fd);
+	fd = -1;
+}
+
+void Journal::reset()
+{
+	if(fd < 0) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	buffer.clear();
+	truncate_pending = true;
+	record_count = 0;
+}
+
+void Journal::remove()
+{
+	if(fd < 0) {
+		return;
+	}
+	close();
+	unlink(filename.c_str());
+}
+
+void Journal::append(const void * data, size_t size)
+{
+	buffer.append((const char*)data, size);
+}
+
+void Journal::writeSpan(int x, int y, const int * values, int count)
+{
+	if(fd < 0 || count <= 0) {
+		return;
+	}
+	int32_t record[4] = { SPAN_RECORD, x, y, count };
+	std::lock_guard<std::mutex> lock(mutex);
+	append(record, sizeof(record));
+	for(int i = 0; i < count; ++i) {
+		int32_t value = values[i];
+		append(&value, sizeof(value));
+	}
+	++record_count;
+	if(buffer.size() > JOURNAL_FLUSH_SIZE) {
+		changed.notify_all();
+	}
+}
+
+void Journal::fillSpan(int x, int y, int count, int value)
+{
+	if(fd < 0 || count <= 0) {
+		return;
+	}
+	int32_t record[5] = { FILL_RECORD, x, y, count, value };
+	std::lock_guard<std::mutex> lock(mutex);
+	append(record, sizeof(record));
+	++record_count;
+}
+
+void Journal::setColor(unsigned index, const Chthon::Color & color)
+{
+	if(fd < 0) {
+		return;
+	}
+	int32_t record[3] = { COLOR_RECORD, int32_t(index), int32_t(color) };
+	std::lock_guard<std::mutex> lock(mutex);
+	append(record, sizeof(record));
+	++record_count;
+}
+
+void Journal::setPaletteSize(size_t size)
+{
+	if(fd < 0) {
+		return;
+	}
+	int32_t record[2] = { PALETTE_SIZE_RECORD, int32_t(size) };
+	std::lock_guard<std::mutex> lock(mutex);
+	append(record, sizeof(record));
+	++record_count;
+}
+
+void Journal::run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while(true) {
+		changed.wait_for(lock, std::chrono::milliseconds(JOURNAL_FLUSH_INTERVAL_MS));
+		bool truncate = truncate_pending;
+		truncate_pending = false;
+		std::string data;
+		data.swap(buffer);
+		bool stop = stopping;
+		lock.unlock();
+
+		if(truncate) {
+			if(ftruncate(fd, JOURNAL_HEADER_SIZE) == 0) {
+				fdatasync(fd);
+			}
+		}
+		size_t written = 0;
+		while(written < data.size()) {
+			ssize_t result = write(fd, data.data() + written, data.size() - written);
+			if(result < 0) {
+				break;
+			}
+			written += result;
+		}
+		if(!data.empty()) {
+			fdatasync(fd);
+		}
+
+		lock.lock();
+		if(stop) {
+			return;
+		}
+	}
+}
+
+bool Journal::hasNewerRecords(const std::string & journal_filename, const std::string & filename)
+{
+	struct stat journal_st, file_st;
+	if(stat(journal_filename.c_str(), &journal_st) != 0 || size_t(journal_st.st_size) <= JOURNAL_HEADER_SIZE) {
+		return false;
+	}
+	if(stat(filename.c_str(), &file_st) != 0) {
+		return true;
+	}
+	return journal_st.st_mtime >= file_st.st_mtime;
+}
+
+bool Journal::replay(const std::string & journal_filename, Image & image, SDL_Rect & changed, bool & palette_changed)
+{
+	std::ifstream file(journal_filename.c_str(), std::ios::binary);
+	std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	changed.x = changed.y = changed.w = changed.h = 0;
+	palette_changed = false;
+	if(data.size() < JOURNAL_HEADER_SIZE || memcmp(data.data(), JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0) {
+		return false;
+	}
+	int32_t size[2];
+	memcpy(size, data.data() + sizeof(JOURNAL_MAGIC), sizeof(size));
+	if(size[0] != int32_t(image.pixels.width()) || size[1] != int32_t(image.pixels.height())) {
+		return false;
+	}
+
+	int left = size[0], top = size[1], right = -1, bottom = -1;
+	size_t pos = JOURNAL_HEADER_SIZE;
+	std::vector<int> values;
+	// Incomplete record at the end is a write interrupted by crash and is ignored.
+	while(pos + sizeof(int32_t) <= data.size()) {
+		int32_t type;
+		memcpy(&type, data.data() + pos, sizeof(type));
+		int32_t record[5];
+		size_t fields = 0;
+		switch(type) {
+			case SPAN_RECORD: fields = 4; break;
+			case FILL_RECORD: fields = 5; break;
+			case COLOR_RECORD: fields = 3; break;
+			case PALETTE_SIZE_RECORD: fields = 2; break;
+			default: return false;
+		}
+		if(pos + fields * sizeof(int32_t) > data.size()) {
+			break;
+		}
+		memcpy(record, data.data() + pos, fields * sizeof(int32_t));
+		pos += fields * sizeof(int32_t);
+		if(type == COLOR_RECORD) {
+			unsigned index = record[1];
+			if(index >= image.palette.size()) {
+				image.palette.resize(index + 1);
+			}
+			image.palette[index] = Chthon::Color(record[2]);
+			palette_changed = true;
+			continue;
+		}
+		if(type == PALETTE_SIZE_RECORD) {
+			if(record[1] <= 0) {
+				return false;
+			}
+			image.palette.resize(record[1]);
+			palette_changed = true;
+			continue;
+		}
+		int x = record[1], y = record[2], count = record[3];
+		if(type == SPAN_RECORD && pos + count * sizeof(int32_t) > data.size()) {
+			break;
+		}
+		if(y < 0 || y >= size[1] || x < 0 || count < 0 || x + count > size[0]) {
+			return false;
+		}
+		if(type == SPAN_RECORD) {
+			values.resize(count);
+			if(count > 0) {
+				memcpy(values.data(), data.data() + pos, count * sizeof(int32_t));
+			}
+			pos += count * sizeof(int32_t);
+			image.pixels.writeSpan(x, y, count, values.data());
+		} else {
+			image.pixels.fillSpan(x, y, count, record[4]);
+		}
+		if(count > 0) {
+			left = std::min(left, x);
+			right = std::max(right, x + count - 1);
+			top = std::min(top, y);
+			bottom = std::max(bottom, y);
+		}
+	}
+	if(right >= left) {
+		changed.x = left;
+		changed.y = top;
+		changed.w = right - left + 1;
+		changed.h = bottom - top + 1;
+	}
+	return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "image.h"
+#include <chthon2/pixmap.h>
+#include <SDL2/SDL.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Append-only binary log of canvas changes for crash recovery.
+// All records hold absolute values, so replaying journal over a file that already has some of the changes saved is harmless.
+// Records are collected in memory and written by background thread in groups.
+class Journal {
+public:
+	Journal();
+	~Journal();
+	// Opens journal for given image size. Existing journal is truncated unless keep_records is set.
+	bool open(const std::string & filename, int width, int height, bool keep_records = false);
+	void close();
+	bool isOpen() const { return fd >= 0; }
+	// Drops all records, e.g. when they are saved to the file.
+	void reset();
+	void remove();
+	unsigned recordCount() const { return record_count; }
+
+	void writeSpan(int x, int y, const int * values, int count);
+	void fillSpan(int x, int y, int count, int value);
+	void setColor(unsigned index, const Chthon::Color & color);
+	// Palette grows by itself with setColor(), but shrinking has to be recorded.
+	void setPaletteSize(size_t size);
+
+	// Journal with records that was modified not earlier than the image file.
+	static bool hasNewerRecords(const std::string & journal_filename, const std::string & filename);
+	// Applies records to image and returns bounding box of changed pixels (w = 0 if none).
+	static bool replay(const std::string & journal_filename, Image & image, SDL_Rect & changed, bool & palette_changed);
+private:
+	std::string filename;
+	int fd;
+	unsigned record_count;
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::string buffer;
+	bool truncate_pending;
+	bool stopping;
+
+	void run();
+	void append(const void * data, size_t size);
+	Journal(const Journal &);
+	Journal & operator=(const Journal &);
+};
@@ -1,4 +1,7 @@
+#include "batch.h"
 #include "pixelwidget.h"
+#include "xpmcache.h"
+#include "profile.h"
 #include <algorithm>
 #include <iostream>
 #include <fstream>
@@ -7,8 +10,18 @@
 struct Options {
 	int width, height;
 	bool hasSize;
+	bool stress;
+	bool headless;
+	bool batch;
+	bool noCache;
+	unsigned threads;
+	int undoMemory;
+	std::vector<BatchOperation> operations;
+	std::vector<std::string> inputs;
+	std::string canvasView;
+	std::string replayFile, recordFile, traceFile;
 	std::string filename;
-	Options() : width(0), height(0), hasSize(false) {}
+	Options() : width(0), height(0), hasSize(false), stress(false), headless(false), batch(false), noCache(false), threads(0), undoMemory(0) {}
 	bool parse(int argc, char ** argv);
 	bool printUsage();
 };
@@ -17,9 +30,28 @@ bool Options::printUsage()
 {
 	static const std::string usage = 
 			"Simple pixel graphic editor.\n"
-			"Usage: pixed [-w WIDTH -h HEIGHT] FILENAME.xpm\n"
+			"Usage: pixed [-w WIDTH -h HEIGHT] [-r texture|rects] [--stress] [--headless] [--replay SCRIPT | --record SCRIPT] [--trace FILE] [--no-cache] [--undo-memory MB] FILENAME.xpm\n"
+			"       pixed --batch [--threads N] [--normalize] [--palette COLORS] [--substitute FROM=TO] [--resize WxH] [--compact] [--quantize N[:dither]] [--verify] FILE|DIR...\n"
 			"\t-w: set width for new image.\n"
 			"\t-h: set height for new image.\n"
+			"\t-r: canvas rendering path: streaming texture (default) or batched rectangles.\n"
+			"\t--stress: continuously pan the image and report frame times on exit; image is not saved.\n"
+			"\t--headless: use dummy video driver and software renderer.\n"
+			"\t--replay: play events from SCRIPT, report frame times and exit; image is not saved.\n"
+			"\t--record: record session events to SCRIPT.\n"
+			"\t--trace: write Chrome trace events to FILE (requires build with PROFILE=1).\n"
+			"\t--no-cache: do not use or write binary cache of decoded image.\n"
+			"\t--undo-memory: memory limit for undo history in megabytes (default is 64).\n"
+			"\t--batch: apply operations to every file (directories are searched for *.xpm) without opening a window; changed files are saved in place.\n"
+			"\t--threads: number of worker threads for batch mode (default is one per CPU).\n"
+			"\t--normalize: rewrite file in normalized form.\n"
+			"\t--palette: replace palette entries in order with comma-separated colors (#rgb, #rrggbb or None).\n"
+			"\t--substitute: replace color FROM with color TO in palette.\n"
+			"\t--resize: resize canvas to WxH; new pixels get first palette color.\n"
+			"\t--compact: remove unused palette entries and merge duplicate colors.\n"
+			"\t--quantize: reduce palette to N colors, optionally with ordered dithering.\n"
+			"\t--verify: check that file is read identically by Chthon and by own reader and that image survives save and load.\n"
+			"Batch operations are applied in the order they are given.\n"
 			"When width and height are specified, file is created anew.\n"
 			"When no width and height are supplied, file is loaded.\n"
 			"Only XPM images are recognized.\n"
@@ -33,13 +65,30 @@ bool Options::parse(int argc, char ** argv)
 	static struct option long_options[] = {
 		{"width", required_argument, 0, 'w'},
 		{"height", required_argument, 0, 'h'},
+		{"render", required_argument, 0, 'r'},
+		{"stress", no_argument, 0, 'S'},
+		{"headless", no_argument, 0, 'H'},
+		{"replay", required_argument, 0, 'P'},
+		{"record", required_argument, 0, 'R'},
+		{"trace", required_argument, 0, 'T'},
+		{"no-cache", no_argument, 0, 'C'},
+		{"undo-memory", required_argument, 0, 'M'},
+		{"batch", no_argument, 0, 'B'},
+		{"threads", required_argument, 0, 'J'},
+		{"normalize", no_argument, 0, 'N'},
+		{"palette", required_argument, 0, 'L'},
+		{"substitute", required_argument, 0, 'U'},
+		{"resize", required_argument, 0, 'Z'},
+		{"compact", no_argument, 0, 'K'},
+		{"quantize", required_argument, 0, 'Q'},
+		{"verify", no_argument, 0, 'V'},
 		{0, 0, 0, 0}
 	};
 	int c;
 	bool has_width = false;
 	bool has_height = false;
 	std::string width_string, height_string;
-	while((c = getopt_long(argc, argv, "w:h:", long_options, 0)) != -1) {
+	while((c = getopt_long(argc, argv, "w:h:r:", long_options, 0)) != -1) {
 		switch(c) {
 			case 'w':
 				has_width = true;
@@ -49,11 +98,78 @@ bool Options::parse(int argc, char ** argv)
 				has_height = true;
 				height_string = optarg;
 				break;
+			case 'r':
+				canvasView = optarg;
+				break;
+			case 'S':
+				stress = true;
+				break;
+			case 'H':
+				headless = true;
+				break;
+			case 'P':
+				replayFile = optarg;
+				break;
+			case 'R':
+				recordFile = optarg;
+				break;
+			case 'T':
+				traceFile = optarg;
+				break;
+			case 'C':
+				noCache = true;
+				break;
+			case 'M':
+				undoMemory = atoi(optarg);
+				if(undoMemory <= 0) {
+					return printUsage();
+				}
+				break;
+			case 'B':
+				batch = true;
+				break;
+			case 'J':
+				if(atoi(optarg) <= 0) {
+					return printUsage();
+				}
+				threads = atoi(optarg);
+				break;
+			case 'N':
+				operations.push_back(BatchOperation(BatchOperation::NORMALIZE));
+				break;
+			case 'L':
+				operations.push_back(BatchOperation(BatchOperation::PALETTE, optarg));
+				break;
+			case 'U':
+				operations.push_back(BatchOperation(BatchOperation::SUBSTITUTE, optarg));
+				break;
+			case 'Z':
+				operations.push_back(BatchOperation(BatchOperation::RESIZE, optarg));
+				break;
+			case 'K':
+				operations.push_back(BatchOperation(BatchOperation::COMPACT));
+				break;
+			case 'Q':
+				operations.push_back(BatchOperation(BatchOperation::QUANTIZE, optarg));
+				break;
+			case 'V':
+				operations.push_back(BatchOperation(BatchOperation::VERIFY));
+				break;
 			case '?':
 			default:
 				return printUsage();
 		}
 	}
+	if(batch) {
+		if(operations.empty() || (argc - optind) < 1 || !check_batch_operations(operations)) {
+			return printUsage();
+		}
+		inputs.assign(argv + optind, argv + argc);
+		return true;
+	}
+	if(!operations.empty()) {
+		return printUsage();
+	}
 	bool hasWidthOrHeight = has_width || has_height;
 	hasSize = has_width && has_height;
 	if(hasWidthOrHeight && !hasSize) {
@@ -92,13 +208,57 @@ bool Options::parse(int argc, char ** argv)
 	return true;
 }
 
+int run(const Options & options)
+{
+	PixelWidget widget(options.filename, options.width, options.height);
+	if(!options.canvasView.empty() && !widget.setCanvasView(options.canvasView)) {
+		std::cerr << "Unknown rendering path: " << options.canvasView << std::endl;
+		return 1;
+	}
+	if(options.undoMemory > 0) {
+		widget.setHistoryBudget(size_t(options.undoMemory) << 20);
+	}
+	if(options.stress) {
+		widget.enableStressMode();
+	}
+	if(options.headless) {
+		widget.enableHeadlessMode();
+	}
+	if(!options.replayFile.empty() && !widget.enableReplay(options.replayFile)) {
+		return 1;
+	}
+	if(!options.recordFile.empty() && !widget.enableRecording(options.recordFile)) {
+		return 1;
+	}
+	if(!options.hasSize && widget.hasUnsavedJournal()) {
+		std::cout << "File '" << options.filename << "' has unsaved changes in journal." << std::endl;
+		std::cout << "Do you want to recover them? ";
+		char response = 'n';
+		std::cin >> response;
+		if(tolower(response) == 'y' && !widget.recoverJournal()) {
+			std::cerr << "Journal does not match the file, changes are not recovered." << std::endl;
+		}
+	}
+	return widget.exec();
+}
+
 int main(int argc, char ** argv)
 {
 	Options options;
 	if(!options.parse(argc, argv)) {
 		return 1;
 	}
-
-	PixelWidget widget(options.filename, options.width, options.height);
-	return widget.exec();
+	if(options.noCache) {
+		disable_xpm_cache();
+	}
+	if(options.batch) {
+		return run_batch(options.operations, options.inputs, options.threads) == 0 ? 0 : 1;
+	}
+	if(!options.traceFile.empty() && !Profile::openTrace(options.traceFile)) {
+		std::cerr << "Cannot write trace to " << options.traceFile << " (profiling requires build with PROFILE=1)." << std::endl;
+		return 1;
+	}
+	int result = run(options);
+	Profile::closeTrace();
+	return result;
 }
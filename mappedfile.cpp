@@ -0,0 +1,37 @@
+#include "mappedfile.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+bool MappedFile::open(const std::string & filename)
+{
+	close();
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if(fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+	void * mapped = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(mapped == MAP_FAILED) {
+		return false;
+	}
+	madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+	data = (char*)mapped;
+	size = st.st_size;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if(data) {
+		munmap(data, size);
+	}
+	data = 0;
+	size = 0;
+}
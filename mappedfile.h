@@ -0,0 +1,21 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+class MappedFile {
+public:
+	MappedFile() : data(0), size(0) {}
+	~MappedFile() { close(); }
+	bool open(const std::string & filename);
+	void close();
+	bool isOpen() const { return data != 0; }
+	const char * begin() const { return data; }
+	const char * end() const { return data + size; }
+	size_t length() const { return size; }
+private:
+	char * data;
+	size_t size;
+
+	MappedFile(const MappedFile &);
+	MappedFile & operator=(const MappedFile &);
+};
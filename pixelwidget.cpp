@@ -1,4 +1,5 @@
 #include "pixelwidget.h"
+#include "profile.h"
 #include <chthon2/files.h>
 #include <chthon2/log.h>
 #include <SDL2/SDL.h>
@@ -7,75 +8,91 @@
 #include <sstream>
 #include <iomanip>
 #include <streambuf>
-
-SDL_Texture * create_dotted_texture(SDL_Renderer * renderer, int size, bool is_h)
-{
-	SDL_Texture * result = 0;
-	SDL_Surface * surface = SDL_CreateRGBSurface(SDL_SWSURFACE,
-			is_h ? size : 1, is_h ? 1 : size, 32,
-			0x00ff0000,
-			0x0000ff00,
-			0x000000ff,
-			0xff000000
-			);
-	if(SDL_MUSTLOCK(surface)) {
-		SDL_LockSurface(surface);
-	}
-	SDL_Rect r;
-	r.x = 0;
-	r.y = 0;
-	r.w = is_h ? size : 1;
-	r.h = is_h ? 1 : size;
-	SDL_FillRect(surface, &r, 0);
-	for(int x = 0; x < size; ++x) {
-		Uint32 * pixel = (Uint32*)surface->pixels;
-		pixel += x;
-		*pixel = ((size + x) % 2 == 0) ? 0xff000000 : 0xffffffff;
-	}
-	if(SDL_MUSTLOCK(surface)) {
-		SDL_UnlockSurface(surface);
-	}
-	result = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, r.w, r.h);
-	SDL_UpdateTexture(result, 0, surface->pixels, surface->pitch);
-	SDL_SetTextureBlendMode(result, SDL_BLENDMODE_BLEND);
-	SDL_FreeSurface(surface);
-	return result;
-}
-
-
+#include <cmath>
+#include <cstdlib>
 
 const int MIN_ZOOM_FACTOR = 2;
+const int DEFAULT_REFRESH_RATE = 60;
+const int IDLE_TIMEOUT = 1000;
 
-enum { DRAWING_MODE, COLOR_INPUT_MODE, COPY_MODE, PASTE_MODE };
+enum { DRAWING_MODE, COLOR_INPUT_MODE, COPY_MODE, PASTE_MODE, QUANTIZE_INPUT_MODE };
 
 PixelWidget::PixelWidget(const std::string & imageFileName, int width, int height)
-	: renderer(0), quit(false), zoomFactor(4), color(0), fileName(imageFileName), canvas(32, 32), mode(DRAWING_MODE), wholeScreenChanged(true), do_draw_grid(false),
-	dot_h(0), dot_v(0)
+	: renderer(0), quit(false), zoomFactor(4), color(0), fileName(imageFileName), canvas(32, 32), mode(DRAWING_MODE), do_draw_grid(false),
+	headless(false), save_on_exit(true), stress_mode(false), has_replay(false),
+	journal_recovered(false), journal_save_pending(false), journal_records_at_save(0),
+	clipboard_register(Clipboard::UNNAMED), register_pending(false), paste_skip_transparent(false), quantize_dither(false),
+	canvas_view(&canvas_texture), redraw_pending(true)
 {
 	if(Chthon::file_exists(fileName) && (width == 0 || height == 0)) {
-		std::ifstream file(fileName.c_str());
-		if(file) {
-			std::string data((std::istreambuf_iterator<char>(file)),
-					std::istreambuf_iterator<char>());
-			try {
-				canvas.load(data);
-			} catch(const Chthon::Pixmap::Exception & e) {
-				std::cerr << e.what << std::endl;
+		try {
+			PROFILE_SCOPE("startLoad");
+			if(!document.startLoad(fileName, canvas)) {
+				std::cerr << "Cannot read " << fileName << std::endl;
 				exit(1);
 			}
+		} catch(const Chthon::Pixmap::Exception & e) {
+			std::cerr << e.what << std::endl;
+			exit(1);
 		}
 	} else {
 		if(width != 0 && height != 0) {
-			canvas = Chthon::Pixmap(width, height);
+			canvas = Image(width, height);
 		}
 	}
 	color = 0;
-	update();
+	damage.addAll();
 }
 
 PixelWidget::~PixelWidget()
 {
-	save();
+	if(save_on_exit) {
+		save();
+	}
+	finishSaves(true);
+	if(journal.isOpen() && journal.recordCount() == 0) {
+		journal.remove();
+	}
+}
+
+void PixelWidget::enableStressMode()
+{
+	stress_mode = true;
+	save_on_exit = false;
+}
+
+void PixelWidget::enableHeadlessMode()
+{
+	headless = true;
+}
+
+bool PixelWidget::enableReplay(const std::string & scriptFileName)
+{
+	if(!replay_script.load(scriptFileName)) {
+		return false;
+	}
+	replay_name = scriptFileName;
+	has_replay = true;
+	save_on_exit = false;
+	return true;
+}
+
+bool PixelWidget::enableRecording(const std::string & scriptFileName)
+{
+	return recorder.open(scriptFileName);
+}
+
+bool PixelWidget::setCanvasView(const std::string & name)
+{
+	if(name == canvas_texture.name()) {
+		canvas_view = &canvas_texture;
+	} else if(name == canvas_rects.name()) {
+		canvas_view = &canvas_rects;
+	} else {
+		return false;
+	}
+	damage.addAll();
+	return true;
 }
 
 void PixelWidget::close()
@@ -83,40 +100,170 @@ void PixelWidget::close()
 	quit = true;
 }
 
+// Copies rows parsed by background loader into canvas, or waits for all of them.
+// Returns false if file has turned out to be invalid.
+bool PixelWidget::updateLoading(bool wait)
+{
+	if(!document.isLoading()) {
+		return true;
+	}
+	PROFILE_SCOPE("loadRows");
+	try {
+		if(wait) {
+			document.finishLoading(canvas);
+			damage.addAll();
+		} else {
+			int first_row = 0;
+			int rows = document.updateLoading(canvas, first_row);
+			if(rows == 0) {
+				return true;
+			}
+			damage.add(0, first_row, canvas.pixels.width(), rows);
+		}
+	} catch(const Chthon::Pixmap::Exception & e) {
+		std::cerr << e.what << std::endl;
+		save_on_exit = false;
+		quit = true;
+		return false;
+	}
+	redraw_pending = true;
+	return true;
+}
+
+int PixelWidget::loadedRows() const
+{
+	return document.isLoading() ? document.loadedRows() : int(canvas.pixels.height());
+}
+
 void PixelWidget::save()
 {
-	std::ofstream file(fileName.c_str());
-	if(file.good()) {
-		file << canvas.save();
+	PROFILE_SCOPE("save");
+	if(!updateLoading(true)) {
+		return;
 	}
+	document.save(fileName, canvas);
+	journal_records_at_save = journal.recordCount();
+	journal_save_pending = true;
 }
 
-void PixelWidget::mousePressEvent(int x, int y)
+// Journal is dropped once everything it holds is safely saved.
+void PixelWidget::finishSaves(bool wait)
 {
-	if(mode == COLOR_INPUT_MODE) {
+	bool ok = wait ? document.waitForSaves() : document.finishSaves();
+	if(!ok) {
+		std::cerr << "Cannot save " << fileName << std::endl;
+		journal_save_pending = false;
 		return;
 	}
+	if(journal_save_pending && !document.isSaving()) {
+		if(journal.recordCount() == journal_records_at_save) {
+			journal.reset();
+		}
+		journal_save_pending = false;
+	}
+}
 
-	Chthon::Point canvas_center = Chthon::Point(canvas.pixels.width() / 2, canvas.pixels.height() / 2);
-	Chthon::Point rect_center = Chthon::Point(rect.w / 2, rect.h / 2);
-	Chthon::Point leftTop = rect_center - (canvas_center - canvasShift) * zoomFactor;
-	Chthon::Point new_cursor = Chthon::Point(
+bool PixelWidget::hasUnsavedJournal() const
+{
+	return save_on_exit && Journal::hasNewerRecords(fileName + ".journal", fileName);
+}
+
+bool PixelWidget::recoverJournal()
+{
+	if(!updateLoading(true)) {
+		return false;
+	}
+	SDL_Rect changed;
+	bool palette_changed = false;
+	if(!Journal::replay(fileName + ".journal", canvas, changed, palette_changed)) {
+		return false;
+	}
+	document.markRows(changed.y, changed.h);
+	if(palette_changed) {
+		for(unsigned i = 0; i < canvas.palette.size(); ++i) {
+			document.markColor(i);
+		}
+	}
+	damage.addAll();
+	journal_recovered = true;
+	return true;
+}
+
+Chthon::Point PixelWidget::screenToCanvas(int x, int y) const
+{
+	Chthon::Point leftTop = imageLeftTop();
+	return clampCursor(Chthon::Point(
 			(x - leftTop.x) / zoomFactor,
 			(y - leftTop.y) / zoomFactor
-			);
+			));
+}
 
-	Chthon::Point shift = new_cursor - cursor;
-	oldCursor = cursor;
-	if(!shift.null()) {
-		shiftCursor(shift, 1);
+void PixelWidget::mousePressEvent(int x, int y)
+{
+	if(mode == COLOR_INPUT_MODE || mode == QUANTIZE_INPUT_MODE) {
+		return;
 	}
-	
-	putColorAtCursor();
+	stroke.begin(screenToCanvas(x, y));
+}
 
-	update();
+void PixelWidget::mouseMoveEvent(int x, int y)
+{
+	if(mode == COLOR_INPUT_MODE || mode == QUANTIZE_INPUT_MODE) {
+		return;
+	}
+	stroke.addPoint(screenToCanvas(x, y));
+}
+
+void PixelWidget::mouseReleaseEvent()
+{
+	applyStroke();
+	stroke.end();
+	history.commit();
+}
+
+void PixelWidget::applyStroke()
+{
+	if(!stroke.hasPending()) {
+		return;
+	}
+	SDL_Rect changed = stroke.apply(canvas, color, loadedRows());
+	const std::vector<Chthon::Point> & written = stroke.writtenPixels();
+	for(size_t i = 0; i < written.size(); ++i) {
+		journal.fillSpan(written[i].x, written[i].y, 1, color);
+		history.addFill(written[i].x, written[i].y, 1, stroke.previousValues()[i], color);
+	}
+	document.markRows(changed.y, changed.h);
+	damage.add(changed);
+	damage.add(cursor.x, cursor.y);
+	cursor = stroke.lastPoint();
+	damage.add(cursor.x, cursor.y);
+}
+
+Chthon::Point key_to_shift(SDL_Keycode key)
+{
+	switch(key) {
+		case SDLK_k: case SDLK_UP: return Chthon::Point(0, -1);
+		case SDLK_j: case SDLK_DOWN: return Chthon::Point(0, 1);
+		case SDLK_h: case SDLK_LEFT: return Chthon::Point(-1, 0);
+		case SDLK_l: case SDLK_RIGHT: return Chthon::Point(1, 0);
+		case SDLK_y: return Chthon::Point(-1, -1);
+		case SDLK_u: return Chthon::Point(1, -1);
+		case SDLK_b: return Chthon::Point(-1, 1);
+		case SDLK_n: return Chthon::Point(1, 1);
+		default: return Chthon::Point();
+	}
 }
 
-void PixelWidget::keyPressEvent(SDL_KeyboardEvent * event)
+// Movement keys typed as text (color input, register name) do not move cursor.
+bool PixelWidget::isMoveKey(SDL_Keycode key) const
+{
+	if(mode == COLOR_INPUT_MODE || mode == QUANTIZE_INPUT_MODE || register_pending) {
+		return false;
+	}
+	return !key_to_shift(key).null();
+}
+
+void PixelWidget::keyPressEvent(SDL_KeyboardEvent * event, int count)
 {
 	if(mode == COLOR_INPUT_MODE) {
 		bool isText = false;
@@ -142,27 +289,45 @@ void PixelWidget::keyPressEvent(SDL_KeyboardEvent * event)
 				colorEntered += c;
 			}
 		}
-		update();
+		return;
+	}
+	if(mode == QUANTIZE_INPUT_MODE) {
+		switch(event->keysym.sym) {
+			case SDLK_BACKSPACE:
+				if(!colorsEntered.empty()) {
+					colorsEntered.erase(colorsEntered.size() - 1, 1);
+				}
+				break;
+			case SDLK_RETURN: case SDLK_RETURN2: endQuantizeInput(); break;
+			case SDLK_ESCAPE: mode = DRAWING_MODE; break;
+			case SDLK_d: quantize_dither = !quantize_dither; break;
+			default:
+				if(event->keysym.sym >= SDLK_0 && event->keysym.sym <= SDLK_9 && colorsEntered.size() < 6) {
+					colorsEntered += char(event->keysym.sym);
+				}
+				break;
+		}
+		return;
+	}
+	if(register_pending) {
+		register_pending = false;
+		char name = char(event->keysym.sym);
+		if(event->keysym.sym >= SDLK_a && event->keysym.sym <= SDLK_z && Clipboard::isRegister(name)) {
+			clipboard_register = name;
+		}
 		return;
 	}
 
-	Chthon::Point shift;
+	Chthon::Point shift = isMoveKey(event->keysym.sym) ? key_to_shift(event->keysym.sym) : Chthon::Point();
 	switch(event->keysym.sym) {
-		case SDLK_k: case SDLK_UP: shift = Chthon::Point(0, -1); break;
-		case SDLK_j: case SDLK_DOWN: shift = Chthon::Point(0, 1); break;
-		case SDLK_h: case SDLK_LEFT: shift = Chthon::Point(-1, 0); break;
-		case SDLK_l: case SDLK_RIGHT: shift = Chthon::Point(1, 0); break;
-		case SDLK_y: shift = Chthon::Point(-1, -1); break;
-		case SDLK_u: shift = Chthon::Point(1, -1); break;
-		case SDLK_b: shift = Chthon::Point(-1, 1); break;
-		case SDLK_n: shift = Chthon::Point(1, 1); break;
-
 		case SDLK_q: close(); break;
 		case SDLK_s: if(event->keysym.mod & (KMOD_RSHIFT | KMOD_LSHIFT)) { save(); }; break;
 		case SDLK_g: if(event->keysym.mod & (KMOD_RCTRL | KMOD_LCTRL)) { switch_draw_grid(); }; break;
 		case SDLK_EQUALS: case SDLK_KP_PLUS:  case SDLK_PLUS: zoomIn(); break;
 		case SDLK_KP_MINUS: case SDLK_MINUS: zoomOut(); break;
 		case SDLK_HOME: centerCanvas(); break;
+		case SDLK_F3: Profile::toggleOverlay(); break;
+		case SDLK_F4: switchCanvasView(); break;
 		case SDLK_f:
 		{
 			if(SDL_GetWindowFlags(window) & SDL_WINDOW_FULLSCREEN_DESKTOP) {
@@ -175,33 +340,55 @@ void PixelWidget::keyPressEvent(SDL_KeyboardEvent * event)
 	}
 	if(mode == COPY_MODE) {
 		switch(event->keysym.sym) {
-			case SDLK_ESCAPE: mode = DRAWING_MODE; break;
-			case SDLK_v: startPasteMode(); break;
+			case SDLK_ESCAPE: mode = DRAWING_MODE; clipboard_register = Clipboard::UNNAMED; break;
+			case SDLK_v: if(copySelection()) { startPasteMode(); } break;
+			case SDLK_RETURN: case SDLK_RETURN2: copySelection(); mode = DRAWING_MODE; clipboard_register = Clipboard::UNNAMED; break;
 			default: break;
 		}
 	} else if(mode == PASTE_MODE) {
 		switch(event->keysym.sym) {
 			case SDLK_RETURN: case SDLK_RETURN2: pasteSelection(); break;
-			case SDLK_ESCAPE: mode = DRAWING_MODE; break;
+			case SDLK_t: paste_skip_transparent = !paste_skip_transparent; break;
+			case SDLK_ESCAPE: mode = DRAWING_MODE; clipboard_register = Clipboard::UNNAMED; break;
 			default: break;
 		}
 	} else if(mode == DRAWING_MODE) {
 		switch(event->keysym.sym) {
 			case SDLK_c: startCopyMode(); break;
-			case SDLK_a: color = canvas.palette.size(); canvas.palette.push_back(0); startColorInput(); break;
+			case SDLK_v: startPasteMode(); break;
+			case SDLK_QUOTE: if(event->keysym.mod & (KMOD_RSHIFT | KMOD_LSHIFT)) { register_pending = true; } break;
+			case SDLK_QUOTEDBL: register_pending = true; break;
+			case SDLK_a:
+				if(event->keysym.mod & (KMOD_RSHIFT | KMOD_LSHIFT)) {
+					compactPalette();
+					break;
+				}
+				color = canvas.palette.size();
+				canvas.palette.push_back(0);
+				journal.setColor(color, 0);
+				history.addPaletteResize(color, canvas.palette.size());
+				startColorInput();
+				break;
+			case SDLK_r: startQuantizeInput(); break;
+			case SDLK_z:
+				if(event->keysym.mod & (KMOD_RSHIFT | KMOD_LSHIFT)) {
+					redo();
+				} else {
+					undo();
+				}
+				break;
 			case SDLK_PAGEUP: pickPrevColor(); break;
 			case SDLK_PAGEDOWN: pickNextColor(); break;
 			case SDLK_3: if(event->keysym.mod & (KMOD_RSHIFT | KMOD_LSHIFT)) { startColorInput(); } break;
 			case SDLK_PERIOD: takeColorUnderCursor(); break;
 			case SDLK_d: case SDLK_i: case SDLK_SPACE: putColorAtCursor(); break;
-			case SDLK_p: floodFill(); break;
+			case SDLK_p: floodFill(event->keysym.mod & (KMOD_RSHIFT | KMOD_LSHIFT)); break;
 		}
 	}
-	oldCursor = cursor;
 	if(!shift.null()) {
-		int speed = 1;
+		int speed = count;
 		if(event->keysym.mod & (KMOD_RCTRL | KMOD_LCTRL)) {
-			speed = 10;
+			speed *= 10;
 		}
 		if(event->keysym.mod & (KMOD_RSHIFT | KMOD_LSHIFT)) {
 			shiftCanvas(shift, speed);
@@ -209,72 +396,110 @@ void PixelWidget::keyPressEvent(SDL_KeyboardEvent * event)
 			shiftCursor(shift, speed);
 		}
 	}
-	update();
 }
 
 void PixelWidget::pasteSelection()
 {
-	selection.w += 1;
-	selection.h += 1;
-	std::vector<int> pixels(selection.w * selection.h);;
-	for(int x = 0; x < selection.w; ++x) {
-		for(int y = 0; y < selection.h; ++y) {
-			pixels[x + y * selection.w] = canvas.pixels.cell(selection.x + x, selection.y + y);
-		}
+	PROFILE_SCOPE("pasteSelection");
+	int skip_index = paste_skip_transparent ? transparentIndex() : -1;
+	SDL_Rect changed = clipboard.paste(clipboard_register, canvas.pixels, cursor.x, cursor.y, loadedRows(), skip_index);
+	const std::vector<int> & before = clipboard.previousPixels();
+	row_values.resize(changed.w);
+	for(int y = 0; y < changed.h; ++y) {
+		int * after = row_values.data();
+		canvas.pixels.readSpan(changed.x, changed.y + y, changed.w, after);
+		journal.writeSpan(changed.x, changed.y + y, after, changed.w);
+		history.addSpan(changed.x, changed.y + y, changed.w, &before[y * changed.w], after);
 	}
-	for(int x = 0; x < selection.w; ++x) {
-		for(int y = 0; y < selection.h; ++y) {
-			int sx = x + cursor.x;
-			int sy = y + cursor.y;
-			canvas.pixels.cell(sx, sy) = pixels[x + y * selection.w];
+	history.commit();
+	if(changed.w > 0) {
+		document.markRows(changed.y, changed.h);
+		damage.add(changed);
+	}
+}
+
+int PixelWidget::transparentIndex() const
+{
+	for(size_t i = 0; i < canvas.palette.size(); ++i) {
+		if(Chthon::is_transparent(canvas.palette[i])) {
+			return i;
 		}
 	}
-	mode = DRAWING_MODE;
-	update();
+	return -1;
 }
 
 void PixelWidget::startCopyMode()
 {
 	mode = COPY_MODE;
 	selection_start = cursor;
-	update();
 }
 
+bool PixelWidget::copySelection()
+{
+	SDL_Rect rect;
+	rect.x = std::min(cursor.x, selection_start.x);
+	rect.y = std::min(cursor.y, selection_start.y);
+	rect.w = std::abs(cursor.x - selection_start.x) + 1;
+	rect.h = std::abs(cursor.y - selection_start.y) + 1;
+	if(!clipboard.copy(clipboard_register, canvas.pixels, rect, loadedRows())) {
+		mode = DRAWING_MODE;
+		clipboard_register = Clipboard::UNNAMED;
+		return false;
+	}
+	damage.add(cursor.x, cursor.y);
+	cursor = Chthon::Point(rect.x, rect.y);
+	return true;
+}
+
+// Selection is a size of block to paste minus one; it starts at cursor.
 void PixelWidget::startPasteMode()
 {
+	if(!clipboard.has(clipboard_register)) {
+		mode = DRAWING_MODE;
+		clipboard_register = Clipboard::UNNAMED;
+		return;
+	}
 	mode = PASTE_MODE;
-	selection.x = std::min(cursor.x, selection_start.x);
-	selection.y = std::min(cursor.y, selection_start.y);
-	selection.w = std::abs(cursor.x - selection_start.x);
-	selection.h = std::abs(cursor.y - selection_start.y);
-	cursor = Chthon::Point(selection.x, selection.y);
-	update();
+	selection.x = cursor.x;
+	selection.y = cursor.y;
+	selection.w = clipboard.width(clipboard_register) - 1;
+	selection.h = clipboard.height(clipboard_register) - 1;
+	cursor = clampCursor(cursor);
 }
 
 void PixelWidget::switch_draw_grid()
 {
 	do_draw_grid = !do_draw_grid;
-	wholeScreenChanged = true;
-	update();
 }
 
-void PixelWidget::recreate_dot_textures()
+void PixelWidget::switchCanvasView()
 {
-	if(dot_h) {
-		SDL_DestroyTexture(dot_h);
-	}
-	dot_h = create_dotted_texture(renderer, zoomFactor, true);
-
-	if(dot_v) {
-		SDL_DestroyTexture(dot_v);
+	if(canvas_view == &canvas_texture) {
+		canvas_view = &canvas_rects;
+	} else {
+		canvas_view = &canvas_texture;
 	}
-	dot_v = create_dotted_texture(renderer, zoomFactor, false);
+	damage.addAll();
 }
 
-void PixelWidget::floodFill()
+void PixelWidget::floodFill(bool eight_connected)
 {
-	canvas.pixels.floodfill(cursor.x, cursor.y, color);
-	update();
+	PROFILE_SCOPE("floodFill");
+	if(document.isLoading()) {
+		return;
+	}
+	int target = canvas.pixels.get(cursor.x, cursor.y);
+	SDL_Rect changed = fill.apply(canvas.pixels, cursor, color, eight_connected);
+	if(changed.w <= 0) {
+		return;
+	}
+	for(const FloodFill::Span & span : fill.filledSpans()) {
+		journal.fillSpan(span.x, span.y, span.length, color);
+		history.addFill(span.x, span.y, span.length, target, color);
+	}
+	history.commit();
+	document.markRows(changed.y, changed.h);
+	damage.add(changed);
 }
 
 void PixelWidget::pickNextColor()
@@ -284,8 +509,6 @@ void PixelWidget::pickNextColor()
 		return;
 	}
 	color = newColor;
-	wholeScreenChanged = false;
-	update();
 }
 
 void PixelWidget::pickPrevColor()
@@ -294,16 +517,85 @@ void PixelWidget::pickPrevColor()
 		return;
 	}
 	--color;
-	wholeScreenChanged = false;
-	update();
+}
+
+ThreadPool * PixelWidget::threadPool()
+{
+	if(!pool) {
+		pool.reset(new ThreadPool);
+	}
+	return pool.get();
+}
+
+void PixelWidget::recordPaletteRemap(const std::vector<IndexRemap::Span> & spans, const std::vector<SDL_Rect> & rects, const std::vector<Chthon::Color> & old_palette)
+{
+	for(const IndexRemap::Span & span : spans) {
+		row_values.resize(span.length);
+		int * after = row_values.data();
+		canvas.pixels.readSpan(span.x, span.y, span.length, after);
+		history.addSpan(span.x, span.y, span.length, span.previous, after);
+		journal.writeSpan(span.x, span.y, after, span.length);
+		document.markRows(span.y);
+	}
+	history.addPaletteResize(old_palette.size(), canvas.palette.size());
+	if(old_palette.size() != canvas.palette.size()) {
+		journal.setPaletteSize(canvas.palette.size());
+	}
+	for(unsigned i = 0; i < old_palette.size() || i < canvas.palette.size(); ++i) {
+		if(i >= canvas.palette.size()) {
+			history.addColor(i, old_palette[i], Chthon::Color());
+		} else if(i >= old_palette.size() || canvas.palette[i] != old_palette[i]) {
+			history.addColor(i, i < old_palette.size() ? old_palette[i] : Chthon::Color(), canvas.palette[i]);
+			journal.setColor(i, canvas.palette[i]);
+			document.markColor(i);
+		}
+	}
+	history.commit();
+	for(const SDL_Rect & rect : rects) {
+		damage.add(rect);
+	}
+}
+
+void PixelWidget::compactPalette()
+{
+	PROFILE_SCOPE("compactPalette");
+	if(document.isLoading()) {
+		return;
+	}
+	if(!compaction.apply(canvas, threadPool(), color)) {
+		return;
+	}
+	recordPaletteRemap(compaction.changedSpans(), compaction.changedRects(), compaction.previousPalette());
+	color = compaction.remap()[color];
+}
+
+void PixelWidget::startQuantizeInput()
+{
+	mode = QUANTIZE_INPUT_MODE;
+	colorsEntered = "";
+}
+
+void PixelWidget::endQuantizeInput()
+{
+	PROFILE_SCOPE("quantize");
+	mode = DRAWING_MODE;
+	int colors = atoi(colorsEntered.c_str());
+	if(colors <= 0 || document.isLoading()) {
+		return;
+	}
+	if(!quantizer.apply(canvas, threadPool(), colors, quantize_dither)) {
+		return;
+	}
+	recordPaletteRemap(quantizer.changedSpans(), quantizer.changedRects(), quantizer.previousPalette());
+	// Entries that keep their index get new colors too, so pixels outside of rewritten spans change as well.
+	damage.addAll();
+	color = quantizer.remap()[color];
 }
 
 void PixelWidget::startColorInput()
 {
 	mode = COLOR_INPUT_MODE;
 	colorEntered = "#";
-	wholeScreenChanged = false;
-	update();
 }
 
 void PixelWidget::endColorInput()
@@ -323,29 +615,86 @@ void PixelWidget::endColorInput()
 			value = Chthon::from_rgb(red, green, blue);
 		}
 	}
+	if(canvas.palette[color] != value) {
+		history.addColor(color, canvas.palette[color], value);
+	}
+	history.commit();
 	canvas.palette[color] = value;
-	wholeScreenChanged = true;
-	update();
+	journal.setColor(color, value);
+	document.markColor(color);
+	damage.addAll();
+}
+
+void PixelWidget::undo()
+{
+	if(history.undo(canvas)) {
+		applyHistoryChange();
+	}
+}
+
+void PixelWidget::redo()
+{
+	if(history.redo(canvas)) {
+		applyHistoryChange();
+	}
+}
+
+void PixelWidget::applyHistoryChange()
+{
+	const History::Change & change = history.lastChange();
+	for(const History::Span & span : change.spans) {
+		row_values.resize(span.length);
+		canvas.pixels.readSpan(span.x, span.y, span.length, row_values.data());
+		journal.writeSpan(span.x, span.y, row_values.data(), span.length);
+	}
+	if(change.bounds.w > 0) {
+		document.markRows(change.bounds.y, change.bounds.h);
+		damage.add(change.bounds);
+	}
+	if(change.palette_resized) {
+		journal.setPaletteSize(canvas.palette.size());
+	}
+	for(unsigned index : change.colors) {
+		journal.setColor(index, canvas.palette[index]);
+		document.markColor(index);
+	}
+	if(change.palette_resized) {
+		color = std::min<unsigned>(color, canvas.palette.size() - 1);
+	}
+	if(!change.colors.empty() || change.palette_resized) {
+		damage.addAll();
+	}
+}
+
+void PixelWidget::setHistoryBudget(size_t bytes)
+{
+	history.setBudget(bytes);
 }
 
 void PixelWidget::putColorAtCursor()
 {
-	canvas.pixels.cell(cursor.x, cursor.y) = color;
-	wholeScreenChanged = false;
-	update();
+	if(cursor.y >= loadedRows()) {
+		return;
+	}
+	int previous = canvas.pixels.get(cursor.x, cursor.y);
+	if(previous != int(color)) {
+		history.addFill(cursor.x, cursor.y, 1, previous, color);
+		history.commit();
+	}
+	canvas.pixels.set(cursor.x, cursor.y, color);
+	journal.fillSpan(cursor.x, cursor.y, 1, color);
+	document.markRows(cursor.y);
+	damage.add(cursor.x, cursor.y);
 }
 
 void PixelWidget::takeColorUnderCursor()
 {
 	color = indexAtPos(cursor);
-	wholeScreenChanged = false;
-	update();
 }
 
 void PixelWidget::shiftCanvas(const Chthon::Point & shift, int speed)
 {
 	canvasShift += shift * speed;
-	update();
 }
 
 void PixelWidget::shiftCursor(const Chthon::Point & shift, int speed)
@@ -353,32 +702,33 @@ void PixelWidget::shiftCursor(const Chthon::Point & shift, int speed)
 	if(speed < 1) {
 		return;
 	}
-	int new_x = cursor.x + shift.x * speed;
-	int new_y = cursor.y + shift.y * speed;
+	damage.add(cursor.x, cursor.y);
+	cursor = clampCursor(cursor + shift * speed);
+	damage.add(cursor.x, cursor.y);
+}
+
+Chthon::Point PixelWidget::clampCursor(const Chthon::Point & pos) const
+{
+	int max_x = int(canvas.pixels.width()) - 1;
+	int max_y = int(canvas.pixels.height()) - 1;
 	if(mode == PASTE_MODE) {
-		new_x = std::max(0, std::min(new_x, int(canvas.pixels.width()) - selection.w - 1));
-		new_y = std::max(0, std::min(new_y, int(canvas.pixels.height()) - selection.h - 1));
-	} else {
-		new_x = std::max(0, std::min(new_x, int(canvas.pixels.width()) - 1));
-		new_y = std::max(0, std::min(new_y, int(canvas.pixels.height()) - 1));
+		max_x -= selection.w;
+		max_y -= selection.h;
 	}
-	oldCursor = cursor;
-	cursor = Chthon::Point(new_x, new_y);
-	wholeScreenChanged = false;
-	update();
+	return Chthon::Point(
+			std::max(0, std::min(pos.x, max_x)),
+			std::max(0, std::min(pos.y, max_y))
+			);
 }
 
 void PixelWidget::centerCanvas()
 {
 	canvasShift = Chthon::Point();
-	update();
 }
 
 void PixelWidget::zoomIn()
 {
 	zoomFactor++;
-	recreate_dot_textures();
-	update();
 }
 
 void PixelWidget::zoomOut()
@@ -387,13 +737,11 @@ void PixelWidget::zoomOut()
 	if(zoomFactor < MIN_ZOOM_FACTOR) {
 		zoomFactor = MIN_ZOOM_FACTOR;
 	}
-	recreate_dot_textures();
-	update();
 }
 
 uint PixelWidget::indexAtPos(const Chthon::Point & pos)
 {
-	return canvas.pixels.cell(pos.x, pos.y);
+	return canvas.pixels.get(pos.x, pos.y);
 }
 
 Chthon::Color PixelWidget::indexToRealColor(uint index)
@@ -409,6 +757,7 @@ void draw_line(SDL_Renderer * renderer, const Chthon::Point & a, const Chthon::P
 void PixelWidget::drawCursor(const SDL_Rect & cursor_rect)
 {
 	SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+	Profile::count(Profile::DRAW_COLOR_CHANGES);
 
 	Chthon::Point width = Chthon::Point(cursor_rect.w, 0);
 	Chthon::Point height = Chthon::Point(0, cursor_rect.h);
@@ -438,29 +787,6 @@ void PixelWidget::drawCursor(const SDL_Rect & cursor_rect)
 	}
 }
 
-void PixelWidget::drawGrid(const Chthon::Point & topLeft)
-{
-	SDL_Rect r;
-	r.x = 0;
-	r.y = 0;
-	r.w = zoomFactor;
-	r.h = zoomFactor;
-	for(unsigned x = 0; x < canvas.pixels.width(); ++x) {
-		for(unsigned y = 0; y < canvas.pixels.height(); ++y) {
-			r.x = topLeft.x + x * zoomFactor;
-			r.y = topLeft.y + y * zoomFactor;
-
-			r.w = zoomFactor;
-			r.h = 1;
-			SDL_RenderCopy(renderer, dot_h, 0, &r);
-
-			r.w = 1;
-			r.h = zoomFactor;
-			SDL_RenderCopy(renderer, dot_v, 0, &r);
-		}
-	}
-}
-
 std::string colorToString(const Chthon::Color & color)
 {
 	if(Chthon::is_transparent(color)) {
@@ -473,51 +799,6 @@ std::string colorToString(const Chthon::Color & color)
 			);
 }
 
-void PixelWidget::draw_pixel(const Chthon::Point & topLeft, const Chthon::Point & pos)
-{
-	Chthon::Color color = canvas.palette[canvas.pixels.cell(pos.x, pos.y)];
-	Chthon::Point p = topLeft + pos * zoomFactor;
-	if(Chthon::is_transparent(color)) {
-		if(zoomFactor % 2 != 0) {
-			SDL_Rect r;
-			r.x = p.x;
-			r.y = p.y;
-			r.w = zoomFactor;
-			r.h = zoomFactor;
-			int i = (pos.x + pos.y) % 2 == 0 ? 0 : 32;
-			SDL_SetRenderDrawColor(renderer, i, i, i, 255);
-			SDL_RenderFillRect(renderer, &r);
-		} else {
-			SDL_Rect r;
-			r.x = p.x;
-			r.y = p.y;
-			r.w = zoomFactor / 2;
-			r.h = zoomFactor / 2;
-
-			SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-			SDL_RenderFillRect(renderer, &r);
-			r.x += zoomFactor / 2;
-			r.y += zoomFactor / 2;
-			SDL_RenderFillRect(renderer, &r);
-
-			SDL_SetRenderDrawColor(renderer, 32, 32, 32, 255);
-			r.x -= zoomFactor / 2;
-			SDL_RenderFillRect(renderer, &r);
-			r.x += zoomFactor / 2;
-			r.y -= zoomFactor / 2;
-			SDL_RenderFillRect(renderer, &r);
-		}
-	} else {
-		SDL_Rect r;
-		r.x = p.x;
-		r.y = p.y;
-		r.w = zoomFactor;
-		r.h = zoomFactor;
-		SDL_SetRenderDrawColor(renderer, Chthon::get_red(color), Chthon::get_green(color), Chthon::get_blue(color), 255);
-		SDL_RenderFillRect(renderer, &r);
-	}
-}
-
 SDL_Rect make_rect(const Chthon::Point & p, int width, int height)
 {
 	SDL_Rect result;
@@ -528,68 +809,57 @@ SDL_Rect make_rect(const Chthon::Point & p, int width, int height)
 	return result;
 }
 
-void PixelWidget::update()
+Chthon::Point PixelWidget::imageLeftTop() const
 {
 	Chthon::Point canvas_center = Chthon::Point(canvas.pixels.width() / 2, canvas.pixels.height() / 2);
 	Chthon::Point rect_center = Chthon::Point(rect.w / 2, rect.h / 2);
-	Chthon::Point leftTop = rect_center - (canvas_center - canvasShift) * zoomFactor;
+	return rect_center - (canvas_center - canvasShift) * zoomFactor;
+}
+
+SDL_Rect PixelWidget::visiblePixels(const Chthon::Point & leftTop) const
+{
+	int left = std::max(0, (rect.x - leftTop.x) / zoomFactor);
+	int top = std::max(0, (rect.y - leftTop.y) / zoomFactor);
+	int right = std::min(int(canvas.pixels.width()), (rect.x + rect.w - leftTop.x + zoomFactor - 1) / zoomFactor);
+	int bottom = std::min(int(canvas.pixels.height()), (rect.y + rect.h - leftTop.y + zoomFactor - 1) / zoomFactor);
+	SDL_Rect result;
+	result.x = left;
+	result.y = top;
+	result.w = std::max(0, right - left);
+	result.h = std::max(0, bottom - top);
+	return result;
+}
+
+void PixelWidget::update()
+{
+	PROFILE_SCOPE("update");
+	Profile::beginFrame();
+	Chthon::Point leftTop = imageLeftTop();
+	SDL_Rect visible = visiblePixels(leftTop);
 	SDL_Rect imageRect = make_rect(leftTop, canvas.pixels.width() * zoomFactor, canvas.pixels.height() * zoomFactor);
 	SDL_Rect cursorRect = make_rect(leftTop + cursor * zoomFactor, zoomFactor, zoomFactor);
-	SDL_Rect oldCursorRect = make_rect(leftTop + oldCursor * zoomFactor, zoomFactor, zoomFactor);
-	SDL_Rect colorUnderCursorRect;
-	colorUnderCursorRect.x = 24;
-	colorUnderCursorRect.y = 8;
-	colorUnderCursorRect.w = 8;
-	colorUnderCursorRect.h = 8;
-	SDL_Rect currentColorRect;
-	currentColorRect.x = 0;
-	currentColorRect.y = 0;
-	currentColorRect.w = 32;
-	currentColorRect.h = 16;
-
-	if(wholeScreenChanged) {
-		SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-		SDL_RenderClear(renderer);
-		SDL_Rect imageRect_adjusted;
-		imageRect_adjusted.x = imageRect.x - 1;
-		imageRect_adjusted.y = imageRect.y - 1;
-		imageRect_adjusted.w = imageRect.w + 3;
-		imageRect_adjusted.h = imageRect.h + 3;
-		SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-		SDL_RenderDrawRect(renderer, &imageRect_adjusted);
-		for(unsigned x = 0; x < canvas.pixels.width(); ++x) {
-			for(unsigned y = 0; y < canvas.pixels.height(); ++y) {
-				draw_pixel(leftTop, Chthon::Point(x, y));
-			}
-		}
-	} else {
-		drawCursor(oldCursorRect);
-	}
-	wholeScreenChanged = true;
 
-	// Erase old selection.
-	if(mode == COPY_MODE) {
-		SDL_Rect old_selected_pixels;
-		old_selected_pixels.x = std::min(oldCursor.x, selection_start.x);
-		old_selected_pixels.y = std::min(oldCursor.y, selection_start.y);
-		old_selected_pixels.w = std::abs(oldCursor.x - selection_start.x);
-		old_selected_pixels.h = std::abs(oldCursor.y - selection_start.y);
-		for(int x = old_selected_pixels.x; x <= old_selected_pixels.x + old_selected_pixels.w; ++x) {
-			int y = old_selected_pixels.y;
-			draw_pixel(leftTop, Chthon::Point(x, y));
-			y = old_selected_pixels.y + old_selected_pixels.h;
-			draw_pixel(leftTop, Chthon::Point(x, y));
-		}
-		for(int y = old_selected_pixels.y; y <= old_selected_pixels.y + old_selected_pixels.h; ++y) {
-			int x = old_selected_pixels.x;
-			draw_pixel(leftTop, Chthon::Point(x, y));
-			x = old_selected_pixels.x + old_selected_pixels.w;
-			draw_pixel(leftTop, Chthon::Point(x, y));
-		}
+	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+	Profile::count(Profile::DRAW_COLOR_CHANGES);
+	SDL_RenderClear(renderer);
+	SDL_Rect imageRect_adjusted;
+	imageRect_adjusted.x = imageRect.x - 1;
+	imageRect_adjusted.y = imageRect.y - 1;
+	imageRect_adjusted.w = imageRect.w + 3;
+	imageRect_adjusted.h = imageRect.h + 3;
+	SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+	Profile::count(Profile::DRAW_COLOR_CHANGES);
+	SDL_RenderDrawRect(renderer, &imageRect_adjusted);
+	{
+		PROFILE_SCOPE("drawCanvas");
+		canvas_view->draw(renderer, canvas, damage, visible, leftTop, zoomFactor);
 	}
+	damage.clear();
+	canvas.pixels.compact();
 
 	if(do_draw_grid) {
-		drawGrid(leftTop);
+		PROFILE_SCOPE("drawGrid");
+		grid.draw(renderer, leftTop, visible, zoomFactor);
 	}
 
 	if(mode == COPY_MODE || mode == PASTE_MODE) {
@@ -611,99 +881,185 @@ void PixelWidget::update()
 			selection_rect.h -= 1;
 		}
 
+		SDL_Texture * dot_h = grid.getHorizontalDots(renderer, zoomFactor);
+		SDL_Texture * dot_v = grid.getVerticalDots(renderer, zoomFactor);
 		SDL_Rect r;
 		r.x = 0;
 		r.y = 0;
 		r.w = zoomFactor;
 		r.h = 1;
-		for(int x = selected_pixels.x; x <= selected_pixels.x + selected_pixels.w; ++x) {
+		int first_x = std::max(selected_pixels.x, visible.x);
+		int last_x = std::min(selected_pixels.x + selected_pixels.w, visible.x + visible.w);
+		for(int x = first_x; x <= last_x; ++x) {
 			r.x = leftTop.x + x * zoomFactor - 1;
 			r.y = leftTop.y + selected_pixels.y * zoomFactor - 1;
 			SDL_RenderCopy(renderer, dot_h, 0, &r);
+			Profile::count(Profile::RENDER_COPIES);
 
 			r.y = leftTop.y + (selected_pixels.y + selected_pixels.h) * zoomFactor + zoomFactor - 1;
 			SDL_RenderCopy(renderer, dot_h, 0, &r);
+			Profile::count(Profile::RENDER_COPIES);
 		}
 		r.w = 1;
 		r.h = zoomFactor;
-		for(int y = selected_pixels.y; y <= selected_pixels.y + selected_pixels.h; ++y) {
+		int first_y = std::max(selected_pixels.y, visible.y);
+		int last_y = std::min(selected_pixels.y + selected_pixels.h, visible.y + visible.h);
+		for(int y = first_y; y <= last_y; ++y) {
 			r.y = leftTop.y + y * zoomFactor - 1;
 			r.x = leftTop.x + selected_pixels.x * zoomFactor - 1;
 			SDL_RenderCopy(renderer, dot_v, 0, &r);
+			Profile::count(Profile::RENDER_COPIES);
 
 			r.x = leftTop.x + (selected_pixels.x + selected_pixels.w) * zoomFactor + zoomFactor - 1;
 			SDL_RenderCopy(renderer, dot_v, 0, &r);
+			Profile::count(Profile::RENDER_COPIES);
 		}
 	}
 
-	draw_pixel(leftTop, cursor);
 	drawCursor(cursorRect);
 
-	Chthon::Point currentColorAreaShift;
-	SDL_Rect palette_rect;
-	palette_rect.x = 0;
-	palette_rect.y = 0;
-	palette_rect.w = 32;
-	palette_rect.h = 16;
-	for(unsigned i = 0; i < canvas.palette.size(); ++i) {
-		palette_rect.y = i * 16;
-		Chthon::Color color = canvas.palette[i];
-		SDL_SetRenderDrawColor(renderer, Chthon::get_red(color), Chthon::get_green(color), Chthon::get_blue(color), 255);
-		SDL_RenderFillRect(renderer, &palette_rect);
-	}
-	SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-	palette_rect.y = 0;
-	palette_rect.h = 16 * canvas.palette.size();
-	SDL_RenderDrawRect(renderer, &palette_rect);
-
-	currentColorRect.y += color * 16;
-	Chthon::Color color_value = canvas.palette[color];
-	SDL_SetRenderDrawColor(renderer, Chthon::get_red(color), Chthon::get_green(color), Chthon::get_blue(color), 255);
-	SDL_RenderFillRect(renderer, &currentColorRect);
-	SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-	SDL_RenderDrawRect(renderer, &currentColorRect);
+	hud.draw(renderer, font, canvas.palette, color, indexToRealColor(indexAtPos(cursor)), statusLine(), rect.w, rect.h);
 
-	colorUnderCursorRect.y += color * 16;
-	color_value = canvas.palette[indexAtPos(cursor)];
-	SDL_SetRenderDrawColor(renderer, Chthon::get_red(color), Chthon::get_green(color), Chthon::get_blue(color), 255);
-	SDL_RenderFillRect(renderer, &colorUnderCursorRect);
-	SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-	SDL_RenderDrawRect(renderer, &colorUnderCursorRect);
+	Profile::drawOverlay(renderer, font, 0, rect.h);
+	Profile::endFrame();
+}
 
-	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-	SDL_Rect text_rect;
-	text_rect.x = 33;
-	text_rect.y = 0;
-	text_rect.w = rect.w - 33;
-	text_rect.h = 16;
-	SDL_RenderFillRect(renderer, &text_rect);
-
-	std::string line;
+std::string PixelWidget::statusLine()
+{
 	switch(mode) {
 		case COLOR_INPUT_MODE:
-			line = colorEntered;
-			break;
+			return colorEntered;
+		case QUANTIZE_INPUT_MODE:
+			return "Reduce to colors: " + colorsEntered + (quantize_dither ? " (dither)" : "");
 		case DRAWING_MODE:
-			line = colorToString(indexToRealColor(color)) + " [" + colorToString(indexToRealColor(indexAtPos(cursor))) + "]";
-			break;
+			if(register_pending) {
+				return "\"";
+			}
+			if(document.isLoading()) {
+				return Chthon::format("Loading {0}%", 100 * loadedRows() / canvas.pixels.height());
+			}
+			if(clipboard_register != Clipboard::UNNAMED) {
+				return std::string("\"") + clipboard_register + " " + colorToString(indexToRealColor(color));
+			}
+			return colorToString(indexToRealColor(color)) + " [" + colorToString(indexToRealColor(indexAtPos(cursor))) + "]";
+		case PASTE_MODE:
+			return std::string("\"") + clipboard_register + (paste_skip_transparent ? " skip transparent" : "");
 	}
+	return std::string();
+}
 
-	SDL_Rect dest_rect;
-	dest_rect.x = 33;
-	dest_rect.y = 2;
-	dest_rect.w = font.getCharRect(0).w;
-	dest_rect.h = font.getCharRect(0).h;
+void PixelWidget::processEvents(const SDL_Event & first_event)
+{
+	pending_events.clear();
+	pending_events.push_back(first_event);
+	SDL_Event event;
+	while(SDL_PollEvent(&event)) {
+		pending_events.push_back(event);
+	}
+	for(const SDL_Event & pending : pending_events) {
+		recorder.record(pending);
+	}
+	dispatchEvents();
+}
 
-	for(const char & ch : line) {
-		SDL_Rect char_rect = font.getCharRect(ch);
-		SDL_RenderCopy(renderer, font.getFont(), &char_rect, &dest_rect);
-		dest_rect.x += dest_rect.w;
+void PixelWidget::dispatchEvents()
+{
+	for(size_t i = 0; i < pending_events.size(); ++i) {
+		SDL_Event & current = pending_events[i];
+		bool handled = true;
+		if(current.type == SDL_KEYDOWN) {
+			int count = 1;
+			bool is_move = isMoveKey(current.key.keysym.sym);
+			while(is_move && i + 1 < pending_events.size()) {
+				const SDL_Event & next = pending_events[i + 1];
+				if(next.type != SDL_KEYDOWN || next.key.keysym.sym != current.key.keysym.sym || next.key.keysym.mod != current.key.keysym.mod) {
+					break;
+				}
+				++count;
+				++i;
+			}
+			keyPressEvent(&current.key, count);
+		} else if(current.type == SDL_MOUSEBUTTONDOWN && current.button.button == SDL_BUTTON_LEFT) {
+			mousePressEvent(current.button.x, current.button.y);
+		} else if(current.type == SDL_MOUSEMOTION && (current.motion.state & SDL_BUTTON_LMASK)) {
+			mouseMoveEvent(current.motion.x, current.motion.y);
+		} else if(current.type == SDL_MOUSEBUTTONUP && current.button.button == SDL_BUTTON_LEFT) {
+			mouseReleaseEvent();
+		} else if(current.type == SDL_MOUSEWHEEL) {
+			hud.scrollPalette(-current.wheel.y);
+		} else if(current.type == SDL_RENDER_TARGETS_RESET) {
+			hud.invalidate();
+		} else if(current.type == SDL_WINDOWEVENT) {
+			if(current.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+				rect.w = current.window.data1;
+				rect.h = current.window.data2;
+			}
+		} else if(current.type == SDL_QUIT) {
+			quit = true;
+		} else {
+			handled = false;
+		}
+		redraw_pending = redraw_pending || handled;
 	}
+	applyStroke();
+}
+
+double elapsed_ms(Uint64 start)
+{
+	return double(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+void PixelWidget::runReplay()
+{
+	FrameStats stats;
+	Uint64 start = SDL_GetPerformanceCounter();
+	const std::vector<ReplayScript::Entry> & entries = replay_script.entries();
+	pending_events.clear();
+	for(size_t i = 0; i <= entries.size() && !quit; ++i) {
+		bool at_end = i == entries.size();
+		if(!at_end && !entries[i].is_frame) {
+			pending_events.push_back(entries[i].event);
+			continue;
+		}
+		if(at_end && pending_events.empty()) {
+			break;
+		}
+		dispatchEvents();
+		pending_events.clear();
+
+		Uint64 frame_start = SDL_GetPerformanceCounter();
+		update();
+		stats.add(elapsed_ms(frame_start));
+		SDL_RenderPresent(renderer);
+	}
+	std::ostringstream title;
+	title << replay_name << " " << canvas.pixels.width() << "x" << canvas.pixels.height() << " (" << canvas_view->name() << ")";
+	stats.report(std::cout, title.str(), elapsed_ms(start));
+}
+
+void PixelWidget::stressFrame()
+{
+	double angle = stress_stats.count() * 0.01;
+	int radius = std::min(canvas.pixels.width(), canvas.pixels.height()) / 3;
+	canvasShift = Chthon::Point(int(radius * std::cos(angle)), int(radius * std::sin(angle)));
+
+	Uint64 start = SDL_GetPerformanceCounter();
+	update();
+	SDL_RenderPresent(renderer);
+	stress_stats.add(elapsed_ms(start));
 }
 
 int PixelWidget::exec()
 {
-	SDL_Init(SDL_INIT_EVERYTHING);
+	if(save_on_exit && !journal.open(fileName + ".journal", canvas.pixels.width(), canvas.pixels.height(), journal_recovered)) {
+		std::cerr << "Cannot open journal " << fileName << ".journal" << std::endl;
+	}
+	if(headless) {
+		setenv("SDL_VIDEODRIVER", "dummy", 1);
+		SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER);
+	} else {
+		SDL_Init(SDL_INIT_EVERYTHING);
+	}
 	window = SDL_CreateWindow(
 			"Pixed",
 			SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
@@ -714,30 +1070,64 @@ int PixelWidget::exec()
 	rect.y = 0;
 	SDL_GetWindowSize(window, &rect.w, &rect.h);
 
-	renderer = SDL_CreateRenderer(window, -1, 0);
+	renderer = SDL_CreateRenderer(window, -1, headless ? SDL_RENDERER_SOFTWARE : 0);
 	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
 	SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
 
 	font.init(renderer);
-	recreate_dot_textures();
 
-	SDL_Event event;
+	SDL_DisplayMode display_mode;
+	int refresh_rate = 0;
+	if(SDL_GetWindowDisplayMode(window, &display_mode) == 0) {
+		refresh_rate = display_mode.refresh_rate;
+	}
+	if(refresh_rate <= 0) {
+		refresh_rate = DEFAULT_REFRESH_RATE;
+	}
+	Uint32 frame_interval = 1000 / refresh_rate;
+	Uint32 last_frame = SDL_GetTicks() - frame_interval;
+	redraw_pending = true;
+
+	if(has_replay || stress_mode) {
+		updateLoading(true);
+	}
+	if(has_replay) {
+		runReplay();
+		quit = true;
+	}
+	Uint64 start = SDL_GetPerformanceCounter();
 	while(!quit) {
-		while(SDL_PollEvent(&event)) {
+		int timeout = IDLE_TIMEOUT;
+		if(redraw_pending || stress_mode) {
+			Uint32 elapsed = SDL_GetTicks() - last_frame;
+			timeout = elapsed < frame_interval ? frame_interval - elapsed : 0;
+		} else if(document.isLoading()) {
+			timeout = frame_interval;
+		}
+		SDL_Event event;
+		if(SDL_WaitEventTimeout(&event, timeout)) {
+			processEvents(event);
+		}
+		updateLoading();
+		finishSaves();
+		if(quit || SDL_GetTicks() - last_frame < frame_interval) {
+			continue;
+		}
+		if(stress_mode) {
+			stressFrame();
+			last_frame = SDL_GetTicks();
+			redraw_pending = false;
+		} else if(redraw_pending) {
 			update();
 			SDL_RenderPresent(renderer);
-
-			if(event.type == SDL_KEYDOWN) {
-				keyPressEvent(&event.key);
-			} else if(event.type == SDL_MOUSEBUTTONDOWN && event.button.button == SDL_BUTTON_LEFT) {
-				mousePressEvent(event.button.x, event.button.y);
-			} else if(event.type == SDL_MOUSEMOTION && event.motion.state && SDL_BUTTON_LMASK) {
-				mousePressEvent(event.motion.x, event.motion.y);
-			} else if(event.type == SDL_QUIT) {
-				quit = true;
-			}
+			recorder.frame();
+			last_frame = SDL_GetTicks();
+			redraw_pending = false;
 		}
 	}
+	if(stress_mode) {
+		stress_stats.report(std::cout, std::string("Stress test (") + canvas_view->name() + ")", elapsed_ms(start));
+	}
 
 	SDL_DestroyRenderer(renderer);
 	SDL_DestroyWindow(window);
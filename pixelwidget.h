@@ -1,5 +1,21 @@
 #pragma once
 #include "font.h"
+#include "canvastexture.h"
+#include "canvasrects.h"
+#include "damage.h"
+#include "grid.h"
+#include "stroke.h"
+#include "floodfill.h"
+#include "hud.h"
+#include "replay.h"
+#include "framestats.h"
+#include "xpmdocument.h"
+#include "journal.h"
+#include "history.h"
+#include "clipboard.h"
+#include "compaction.h"
+#include "quantize.h"
+#include "threadpool.h"
 #include <chthon2/pixmap.h>
 #include <chthon2/point.h>
 #include <SDL2/SDL.h>
@@ -10,10 +26,20 @@ public:
 	virtual ~PixelWidget();
 
 	int exec();
+	void enableStressMode();
+	void enableHeadlessMode();
+	bool enableReplay(const std::string & scriptFileName);
+	bool enableRecording(const std::string & scriptFileName);
+	bool setCanvasView(const std::string & name);
+	bool hasUnsavedJournal() const;
+	bool recoverJournal();
+	void setHistoryBudget(size_t bytes);
 protected:
 	void update();
-	virtual void keyPressEvent(SDL_KeyboardEvent * event);
+	virtual void keyPressEvent(SDL_KeyboardEvent * event, int count = 1);
 	virtual void mousePressEvent(int x, int y);
+	virtual void mouseMoveEvent(int x, int y);
+	virtual void mouseReleaseEvent();
 	void close();
 private:
 	SDL_Window * window;
@@ -21,42 +47,95 @@ private:
 	bool quit;
 	int zoomFactor;
 	Chthon::Point canvasShift;
-	Chthon::Point cursor, oldCursor;
+	Chthon::Point cursor;
 	uint color;
 	std::string fileName;
-	Chthon::Pixmap canvas;
+	Image canvas;
+	XpmDocument document;
 	int mode;
 	std::string colorEntered;
-	bool wholeScreenChanged;
+	Damage damage;
 	bool do_draw_grid;
 	Chthon::Point selection_start;
 	SDL_Rect selection;
 	SDL_Rect rect;
-	SDL_Texture * dot_h;
-	SDL_Texture * dot_v;
 	Font font;
+	Grid grid;
+	Stroke stroke;
+	FloodFill fill;
+	Hud hud;
+	bool headless;
+	bool save_on_exit;
+	bool stress_mode;
+	FrameStats stress_stats;
+	bool has_replay;
+	ReplayScript replay_script;
+	std::string replay_name;
+	Recorder recorder;
+	Journal journal;
+	bool journal_recovered;
+	bool journal_save_pending;
+	unsigned journal_records_at_save;
+	History history;
+	Clipboard clipboard;
+	char clipboard_register;
+	bool register_pending;
+	bool paste_skip_transparent;
+	PaletteCompaction compaction;
+	Quantizer quantizer;
+	std::string colorsEntered;
+	bool quantize_dither;
+	std::unique_ptr<ThreadPool> pool;
+	std::vector<int> row_values;
+	CanvasTexture canvas_texture;
+	CanvasRects canvas_rects;
+	CanvasView * canvas_view;
+	bool redraw_pending;
+	std::vector<SDL_Event> pending_events;
 
 	void switch_draw_grid();
+	void switchCanvasView();
 	Chthon::Color indexToRealColor(uint index);
 	uint indexAtPos(const Chthon::Point & pos);
-	void floodFill();
+	bool isMoveKey(SDL_Keycode key) const;
+	void floodFill(bool eight_connected);
+	void undo();
+	void redo();
+	void applyHistoryChange();
 	void zoomIn();
 	void zoomOut();
 	void shiftCanvas(const Chthon::Point & shift, int speed = 1);
 	void centerCanvas();
 	void shiftCursor(const Chthon::Point & shift, int speed = 1);
+	Chthon::Point clampCursor(const Chthon::Point & pos) const;
+	Chthon::Point screenToCanvas(int x, int y) const;
+	void applyStroke();
 	void putColorAtCursor();
 	void takeColorUnderCursor();
 	void startColorInput();
 	void endColorInput();
 	void pickNextColor();
 	void pickPrevColor();
+	ThreadPool * threadPool();
+	void recordPaletteRemap(const std::vector<IndexRemap::Span> & spans, const std::vector<SDL_Rect> & rects, const std::vector<Chthon::Color> & old_palette);
+	void compactPalette();
+	void startQuantizeInput();
+	void endQuantizeInput();
 	void save();
+	void finishSaves(bool wait = false);
+	bool updateLoading(bool wait = false);
+	int loadedRows() const;
 	void startCopyMode();
+	bool copySelection();
 	void startPasteMode();
+	int transparentIndex() const;
 	void drawCursor(const SDL_Rect & rect);
+	std::string statusLine();
 	void pasteSelection();
-	void draw_pixel(const Chthon::Point & topLeft, const Chthon::Point & pos);
-	void drawGrid(const Chthon::Point & topLeft);
-	void recreate_dot_textures();
+	Chthon::Point imageLeftTop() const;
+	SDL_Rect visiblePixels(const Chthon::Point & leftTop) const;
+	void processEvents(const SDL_Event & first_event);
+	void dispatchEvents();
+	void runReplay();
+	void stressFrame();
 };
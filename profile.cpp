@@ -0,0 +1,173 @@
+#include "profile.h"
+#ifdef PIXED_PROFILE
+#include "font.h"
+#include <SDL2/SDL.h>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace Profile {
+
+struct State {
+	std::mutex mutex;
+	std::ofstream trace;
+	bool has_events;
+	bool show_overlay;
+	int counters[COUNTER_COUNT];
+	int last_counters[COUNTER_COUNT];
+	long long frame_start;
+	double last_frame_time;
+	State() : has_events(false), show_overlay(false), frame_start(0), last_frame_time(0)
+	{
+		for(int i = 0; i < COUNTER_COUNT; ++i) {
+			counters[i] = last_counters[i] = 0;
+		}
+	}
+};
+
+State & state()
+{
+	static State instance;
+	return instance;
+}
+
+long long now()
+{
+	static const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+unsigned thread_id()
+{
+	return unsigned(std::hash<std::thread::id>()(std::this_thread::get_id()) % 100000);
+}
+
+void write_event(const std::string & event)
+{
+	State & s = state();
+	std::lock_guard<std::mutex> lock(s.mutex);
+	if(!s.trace.is_open()) {
+		return;
+	}
+	if(s.has_events) {
+		s.trace << ",\n";
+	}
+	s.trace << event;
+	s.has_events = true;
+}
+
+Scope::Scope(const char * scope_name)
+	: name(scope_name), start(now())
+{
+}
+
+Scope::~Scope()
+{
+	if(!state().trace.is_open()) {
+		return;
+	}
+	std::ostringstream event;
+	event << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread_id()
+		<< ",\"ts\":" << start << ",\"dur\":" << now() - start << "}";
+	write_event(event.str());
+}
+
+void count(Counter counter, int amount)
+{
+	state().counters[counter] += amount;
+}
+
+void beginFrame()
+{
+	State & s = state();
+	s.frame_start = now();
+	for(int i = 0; i < COUNTER_COUNT; ++i) {
+		s.counters[i] = 0;
+	}
+}
+
+void endFrame()
+{
+	State & s = state();
+	long long end = now();
+	s.last_frame_time = (end - s.frame_start) / 1000.0;
+	for(int i = 0; i < COUNTER_COUNT; ++i) {
+		s.last_counters[i] = s.counters[i];
+	}
+	if(!s.trace.is_open()) {
+		return;
+	}
+	std::ostringstream event;
+	event << "{\"name\":\"draw calls\",\"ph\":\"C\",\"pid\":1,\"tid\":" << thread_id() << ",\"ts\":" << end
+		<< ",\"args\":{\"fill_rects\":" << s.counters[FILL_RECTS]
+		<< ",\"render_copies\":" << s.counters[RENDER_COPIES]
+		<< ",\"draw_color_changes\":" << s.counters[DRAW_COLOR_CHANGES] << "}}";
+	write_event(event.str());
+}
+
+bool openTrace(const std::string & filename)
+{
+	State & s = state();
+	std::lock_guard<std::mutex> lock(s.mutex);
+	s.trace.open(filename.c_str());
+	if(!s.trace) {
+		return false;
+	}
+	s.trace << "{\"traceEvents\":[\n";
+	s.has_events = false;
+	return true;
+}
+
+void closeTrace()
+{
+	State & s = state();
+	std::lock_guard<std::mutex> lock(s.mutex);
+	if(!s.trace.is_open()) {
+		return;
+	}
+	s.trace << "\n]}\n";
+	s.trace.close();
+}
+
+void toggleOverlay()
+{
+	state().show_overlay = !state().show_overlay;
+}
+
+void drawOverlay(SDL_Renderer * renderer, const Font & font, int x, int y)
+{
+	State & s = state();
+	if(!s.show_overlay) {
+		return;
+	}
+	char lines[2][64];
+	snprintf(lines[0], sizeof(lines[0]), "%.2f ms", s.last_frame_time);
+	snprintf(lines[1], sizeof(lines[1]), "F%d C%d D%d",
+			s.last_counters[FILL_RECTS], s.last_counters[RENDER_COPIES], s.last_counters[DRAW_COLOR_CHANGES]);
+
+	SDL_Rect char_size = font.getCharRect(0);
+	SDL_Rect background;
+	background.x = x;
+	background.y = y - 2 * char_size.h;
+	background.w = 16 * char_size.w;
+	background.h = 2 * char_size.h;
+	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 192);
+	SDL_RenderFillRect(renderer, &background);
+	for(int line = 0; line < 2; ++line) {
+		SDL_Rect dest_rect = char_size;
+		dest_rect.x = x;
+		dest_rect.y = background.y + line * char_size.h;
+		for(const char * ch = lines[line]; *ch; ++ch) {
+			SDL_Rect char_rect = font.getCharRect(*ch);
+			SDL_RenderCopy(renderer, font.getFont(), &char_rect, &dest_rect);
+			dest_rect.x += dest_rect.w;
+		}
+	}
+}
+
+}
+#endif
@@ -0,0 +1,49 @@
+#pragma once
+#include <string>
+class Font;
+struct SDL_Renderer;
+
+// Instrumentation is compiled in only when PIXED_PROFILE is defined (make PROFILE=1).
+// Otherwise every function below is an empty inline and PROFILE_SCOPE expands to nothing.
+namespace Profile {
+
+enum Counter { FILL_RECTS, RENDER_COPIES, DRAW_COLOR_CHANGES, COUNTER_COUNT };
+
+#ifdef PIXED_PROFILE
+
+class Scope {
+public:
+	Scope(const char * scope_name);
+	~Scope();
+private:
+	const char * name;
+	long long start;
+};
+
+void count(Counter counter, int amount = 1);
+void beginFrame();
+void endFrame();
+bool openTrace(const std::string & filename);
+void closeTrace();
+void toggleOverlay();
+void drawOverlay(SDL_Renderer * renderer, const Font & font, int x, int y);
+
+#define PROFILE_SCOPE_CONCAT(a, b) a##b
+#define PROFILE_SCOPE_NAME(line) PROFILE_SCOPE_CONCAT(profile_scope_, line)
+#define PROFILE_SCOPE(name) Profile::Scope PROFILE_SCOPE_NAME(__LINE__)(name)
+
+#else
+
+inline void count(Counter, int = 1) {}
+inline void beginFrame() {}
+inline void endFrame() {}
+inline bool openTrace(const std::string &) { return false; }
+inline void closeTrace() {}
+inline void toggleOverlay() {}
+inline void drawOverlay(SDL_Renderer *, const Font &, int, int) {}
+
+#define PROFILE_SCOPE(name)
+
+#endif
+
+}
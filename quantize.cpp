@@ -0,0 +1,194 @@
+#include "quantize.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+namespace {
+
+const int BAYER[IndexRemap::PATTERN_SIZE * IndexRemap::PATTERN_SIZE] = {
+	0, 8, 2, 10,
+	12, 4, 14, 6,
+	3, 11, 1, 9,
+	15, 7, 13, 5,
+};
+const size_t INDICES_PER_TASK = 64;
+
+int nearest_entry(const std::vector<Chthon::Color> & palette, size_t first, const double target[3])
+{
+	int result = first;
+	double best = -1;
+	for(size_t i = first; i < palette.size(); ++i) {
+		double red = Chthon::get_red(palette[i]) - target[0];
+		double green = Chthon::get_green(palette[i]) - target[1];
+		double blue = Chthon::get_blue(palette[i]) - target[2];
+		double distance = red * red + green * green + blue * blue;
+		if(best < 0 || distance < best) {
+			best = distance;
+			result = i;
+		}
+	}
+	return result;
+}
+
+}
+
+// Box with the largest spread weighted by pixel count is split at weighted median of its widest channel,
+// which roughly gives the largest decrease of squared error per split.
+void Quantizer::medianCut(std::vector<Entry> & entries, unsigned colors, std::vector<Chthon::Color> & palette)
+{
+	struct Box {
+		size_t begin, end;
+		int axis;
+		double priority;
+	};
+	auto measure = [&entries](Box & box) {
+		int low[3] = { 255, 255, 255 }, high[3] = { 0, 0, 0 };
+		double count = 0;
+		for(size_t i = box.begin; i < box.end; ++i) {
+			for(int c = 0; c < 3; ++c) {
+				low[c] = std::min(low[c], entries[i].channels[c]);
+				high[c] = std::max(high[c], entries[i].channels[c]);
+			}
+			count += entries[i].count;
+		}
+		box.axis = 0;
+		for(int c = 1; c < 3; ++c) {
+			if(high[c] - low[c] > high[box.axis] - low[box.axis]) {
+				box.axis = c;
+			}
+		}
+		box.priority = (high[box.axis] - low[box.axis]) * count;
+	};
+
+	std::vector<Box> boxes;
+	if(!entries.empty()) {
+		Box box = { 0, entries.size(), 0, 0 };
+		measure(box);
+		boxes.push_back(box);
+	}
+	while(!boxes.empty() && boxes.size() < colors) {
+		size_t widest = 0;
+		for(size_t i = 1; i < boxes.size(); ++i) {
+			if(boxes[i].priority > boxes[widest].priority) {
+				widest = i;
+			}
+		}
+		Box & box = boxes[widest];
+		if(box.priority <= 0) {
+			break;
+		}
+		int axis = box.axis;
+		std::sort(entries.begin() + box.begin, entries.begin() + box.end, [axis](const Entry & a, const Entry & b) {
+			return a.channels[axis] < b.channels[axis];
+		});
+		double total = 0;
+		for(size_t i = box.begin; i < box.end; ++i) {
+			total += entries[i].count;
+		}
+		double half = 0;
+		size_t split = box.begin + 1;
+		while(split < box.end - 1 && half + entries[split - 1].count < total / 2) {
+			half += entries[split - 1].count;
+			++split;
+		}
+		Box second = { split, box.end, 0, 0 };
+		box.end = split;
+		measure(box);
+		measure(second);
+		boxes.push_back(second);
+	}
+
+	for(const Box & box : boxes) {
+		double sums[3] = { 0, 0, 0 };
+		double count = 0;
+		for(size_t i = box.begin; i < box.end; ++i) {
+			for(int c = 0; c < 3; ++c) {
+				sums[c] += double(entries[i].channels[c]) * entries[i].count;
+			}
+			count += entries[i].count;
+		}
+		palette.push_back(Chthon::from_rgb(
+					int(sums[0] / count + 0.5), int(sums[1] / count + 0.5), int(sums[2] / count + 0.5)
+					));
+	}
+}
+
+bool Quantizer::apply(Image & image, ThreadPool * pool, unsigned colors, bool dither)
+{
+	if(colors == 0) {
+		return false;
+	}
+	size_t old_colors = image.palette.size();
+	std::vector<unsigned> histogram = count_indices(image.pixels, old_colors, pool);
+
+	// Entries of the same color are merged, so every box holds distinct colors.
+	std::map<Chthon::Color, size_t> entry_of;
+	std::vector<Entry> entries;
+	std::vector<Chthon::Color> palette;
+	for(size_t index = 0; index < old_colors; ++index) {
+		const Chthon::Color & color = image.palette[index];
+		if(histogram[index] == 0) {
+			continue;
+		}
+		if(Chthon::is_transparent(color)) {
+			if(palette.empty()) {
+				palette.push_back(color);
+			}
+			continue;
+		}
+		std::map<Chthon::Color, size_t>::iterator found = entry_of.find(color);
+		if(found == entry_of.end()) {
+			Entry entry = { { Chthon::get_red(color), Chthon::get_green(color), Chthon::get_blue(color) }, 0 };
+			found = entry_of.insert(std::make_pair(color, entries.size())).first;
+			entries.push_back(entry);
+		}
+		entries[found->second].count += histogram[index];
+	}
+	size_t first_opaque = palette.size();
+	unsigned opaque_colors = std::max<int>(1, int(colors) - int(first_opaque));
+	medianCut(entries, opaque_colors, palette);
+	if(palette.empty()) {
+		return false;
+	}
+
+	int cells = dither ? IndexRemap::PATTERN_SIZE * IndexRemap::PATTERN_SIZE : 1;
+	double spread = 255.0 / std::cbrt(double(std::max<size_t>(1, palette.size() - first_opaque)));
+	nearest.assign(old_colors, 0);
+	table.assign(cells * old_colors, 0);
+	run_parallel(pool, (old_colors + INDICES_PER_TASK - 1) / INDICES_PER_TASK, [&](size_t task) {
+		size_t end = std::min(old_colors, (task + 1) * INDICES_PER_TASK);
+		for(size_t index = task * INDICES_PER_TASK; index < end; ++index) {
+			const Chthon::Color & color = image.palette[index];
+			if(Chthon::is_transparent(color) || palette.size() == first_opaque) {
+				for(int cell = 0; cell < cells; ++cell) {
+					table[cell * old_colors + index] = 0;
+				}
+				continue;
+			}
+			double target[3] = { double(Chthon::get_red(color)), double(Chthon::get_green(color)), double(Chthon::get_blue(color)) };
+			nearest[index] = nearest_entry(palette, first_opaque, target);
+			for(int cell = 0; cell < cells; ++cell) {
+				double offset = dither ? ((BAYER[cell] + 0.5) / cells - 0.5) * spread : 0;
+				double shifted[3];
+				for(int c = 0; c < 3; ++c) {
+					shifted[c] = std::min(255.0, std::max(0.0, target[c] + offset));
+				}
+				table[cell * old_colors + index] = dither ? nearest_entry(palette, first_opaque, shifted) : nearest[index];
+			}
+		}
+	});
+
+	bool identity = palette == image.palette;
+	for(size_t i = 0; identity && i < table.size(); ++i) {
+		identity = table[i] == int(i % old_colors);
+	}
+	if(identity) {
+		return false;
+	}
+	pixels.apply(image.pixels, table, old_colors, dither, pool);
+	old_palette.swap(image.palette);
+	image.palette.swap(palette);
+	image.pixels.setColorCount(image.palette.size());
+	image.pixels.compact();
+	return true;
+}
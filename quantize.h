@@ -0,0 +1,36 @@
+#pragma once
+#include "image.h"
+#include "remap.h"
+#include <SDL2/SDL.h>
+#include <vector>
+
+class ThreadPool;
+
+// Reduces palette to given number of colors.
+// New palette is found by median cut over used palette entries weighted by their pixel counts, so it costs nothing per pixel;
+// then every pixel is rewritten through precomputed table of nearest new entries.
+// With ordered dithering there is such table for every cell of 4x4 Bayer matrix.
+// Transparent pixels stay transparent and take one of the entries; at least one opaque entry is kept even if that exceeds given number.
+class Quantizer {
+public:
+	Quantizer() {}
+	// Returns false and leaves image intact if image already has nothing to reduce.
+	bool apply(Image & image, ThreadPool * pool, unsigned colors, bool dither);
+	// Old index -> nearest new index (without dithering) for the last apply(); unused entries are mapped to it too.
+	const std::vector<int> & remap() const { return nearest; }
+	// Palette before the last apply().
+	const std::vector<Chthon::Color> & previousPalette() const { return old_palette; }
+	const std::vector<IndexRemap::Span> & changedSpans() const { return pixels.changedSpans(); }
+	const std::vector<SDL_Rect> & changedRects() const { return pixels.changedRects(); }
+private:
+	struct Entry {
+		int channels[3];
+		unsigned count;
+	};
+	std::vector<int> nearest;
+	std::vector<int> table;
+	std::vector<Chthon::Color> old_palette;
+	IndexRemap pixels;
+
+	static void medianCut(std::vector<Entry> & entries, unsigned colors, std::vector<Chthon::Color> & palette);
+};
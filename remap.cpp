@@ -0,0 +1,126 @@
+#include "remap.h"
+#include "threadpool.h"
+#include <algorithm>
+
+namespace {
+
+const int BANDS_PER_THREAD = 4;
+
+// Bands are made of whole rows of tiles, so that they can be rewritten concurrently.
+size_t band_count(ThreadPool * pool, int height)
+{
+	size_t tile_rows = (height + TiledCanvas::TILE_SIZE - 1) / TiledCanvas::TILE_SIZE;
+	return std::min<size_t>(tile_rows, (pool ? pool->size() : 1) * BANDS_PER_THREAD);
+}
+
+int band_top(size_t band, size_t count, int height)
+{
+	size_t tile_rows = (height + TiledCanvas::TILE_SIZE - 1) / TiledCanvas::TILE_SIZE;
+	return std::min<int>(height, tile_rows * band / count * TiledCanvas::TILE_SIZE);
+}
+
+}
+
+void run_parallel(ThreadPool * pool, size_t count, const std::function<void(size_t)> & task)
+{
+	if(pool) {
+		pool->run(count, task);
+	} else {
+		for(size_t i = 0; i < count; ++i) {
+			task(i);
+		}
+	}
+}
+
+std::vector<unsigned> count_indices(const TiledCanvas & pixels, size_t colors, ThreadPool * pool)
+{
+	int height = pixels.height();
+	size_t count = band_count(pool, height);
+	std::vector<std::vector<unsigned> > histograms(count);
+	run_parallel(pool, count, [&](size_t i) {
+		std::vector<unsigned> & histogram = histograms[i];
+		histogram.assign(colors, 0);
+		pixels.countValues(band_top(i, count, height), band_top(i + 1, count, height), histogram);
+	});
+	std::vector<unsigned> result(colors, 0);
+	for(const std::vector<unsigned> & histogram : histograms) {
+		for(size_t index = 0; index < colors; ++index) {
+			result[index] += histogram[index];
+		}
+	}
+	return result;
+}
+
+bool IndexRemap::apply(TiledCanvas & pixels, const std::vector<int> & table, size_t colors, bool patterned, ThreadPool * pool)
+{
+	spans.clear();
+	rects.clear();
+	int width = pixels.width();
+	int height = pixels.height();
+	int max_value = 0;
+	for(int value : table) {
+		max_value = std::max(max_value, value);
+	}
+	pixels.fit(max_value);
+	size_t count = band_count(pool, height);
+	bands.resize(count);
+	run_parallel(pool, count, [&](size_t i) {
+		Band & band = bands[i];
+		band.spans.clear();
+		band.previous.clear();
+		band.row.resize(width);
+		band.bounds.x = band.bounds.y = band.bounds.w = band.bounds.h = 0;
+		int * row = band.row.data();
+		int left = width, right = -1;
+		for(int y = band_top(i, count, height); y < band_top(i + 1, count, height); ++y) {
+			pixels.readSpan(0, y, width, row);
+			const int * lookup = table.data() + (patterned ? (y % PATTERN_SIZE) * PATTERN_SIZE * colors : 0);
+			int first = -1, last = -1;
+			for(int x = 0; x < width; ++x) {
+				unsigned index = row[x];
+				const int * cell = lookup + (patterned ? (x % PATTERN_SIZE) * colors : 0);
+				if(index < colors && cell[index] != int(index)) {
+					if(first < 0) {
+						first = x;
+					}
+					last = x;
+				}
+			}
+			if(first < 0) {
+				continue;
+			}
+			Span span = { first, y, last - first + 1, 0 };
+			band.previous.insert(band.previous.end(), row + first, row + last + 1);
+			for(int x = first; x <= last; ++x) {
+				unsigned index = row[x];
+				if(index < colors) {
+					row[x] = lookup[(patterned ? (x % PATTERN_SIZE) * colors : 0) + index];
+				}
+			}
+			pixels.writeSpan(first, y, span.length, row + first);
+			band.spans.push_back(span);
+			left = std::min(left, first);
+			right = std::max(right, last);
+		}
+		if(band.spans.empty()) {
+			return;
+		}
+		// Buffer may grow while band is processed, so pointers to previous values are set after that.
+		const int * previous = band.previous.data();
+		for(Span & span : band.spans) {
+			span.previous = previous;
+			previous += span.length;
+		}
+		band.bounds.x = left;
+		band.bounds.y = band.spans.front().y;
+		band.bounds.w = right - left + 1;
+		band.bounds.h = band.spans.back().y - band.bounds.y + 1;
+	});
+	for(const Band & band : bands) {
+		spans.insert(spans.end(), band.spans.begin(), band.spans.end());
+		if(band.bounds.w > 0) {
+			rects.push_back(band.bounds);
+		}
+	}
+	return !spans.empty();
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "tiledcanvas.h"
+#include <SDL2/SDL.h>
+#include <functional>
+#include <vector>
+
+class ThreadPool;
+
+// Calls task(i) for every i in [0, count) on pool threads, or on the calling thread when there is no pool.
+void run_parallel(ThreadPool * pool, size_t count, const std::function<void(size_t)> & task);
+
+// Counts pixels of every index below colors over bands of rows; other values are ignored.
+std::vector<unsigned> count_indices(const TiledCanvas & pixels, size_t colors, ThreadPool * pool);
+
+// Rewrites pixel indices through lookup table over bands of rows, keeping previous values of rewritten spans.
+class IndexRemap {
+public:
+	// Row part with rewritten indices.
+	struct Span {
+		int x, y, length;
+		const int * previous; // Values before rewriting.
+	};
+	static const int PATTERN_SIZE = 4;
+	IndexRemap() {}
+	// Table has an entry for every index below colors; other values are left as is.
+	// Patterned table has such entries for every cell of PATTERN_SIZE x PATTERN_SIZE tile, row by row,
+	// so pixel (x, y) is mapped through table[((y % PATTERN_SIZE) * PATTERN_SIZE + x % PATTERN_SIZE) * colors + index].
+	// Returns false if no pixel was changed.
+	bool apply(TiledCanvas & pixels, const std::vector<int> & table, size_t colors, bool patterned, ThreadPool * pool);
+	// Rewritten spans in row order, and bounding boxes of rewritten pixels per band.
+	const std::vector<Span> & changedSpans() const { return spans; }
+	const std::vector<SDL_Rect> & changedRects() const { return rects; }
+private:
+	struct Band {
+		std::vector<Span> spans;
+		std::vector<int> previous;
+		std::vector<int> row;
+		SDL_Rect bounds;
+	};
+	std::vector<Band> bands;
+	std::vector<Span> spans;
+	std::vector<SDL_Rect> rects;
+};
@@ -0,0 +1,165 @@
+#include "replay.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+SDL_Keycode parse_key(const std::string & token)
+{
+	if(token.size() == 1) {
+		return SDL_Keycode(token[0]);
+	}
+	char * end = 0;
+	long value = strtol(token.c_str(), &end, 0);
+	if(end && *end == 0) {
+		return SDL_Keycode(value);
+	}
+	return SDL_GetKeyFromName(token.c_str());
+}
+
+bool ReplayScript::load(const std::string & filename)
+{
+	std::ifstream file(filename.c_str());
+	if(!file) {
+		std::cerr << "Cannot open replay script '" << filename << "'." << std::endl;
+		return false;
+	}
+	script.clear();
+	std::vector<size_t> repeat_starts;
+	std::vector<int> repeat_counts;
+	int mouse_x = 0, mouse_y = 0;
+	int line_number = 0;
+	std::string line;
+	while(std::getline(file, line)) {
+		++line_number;
+		std::istringstream in(line);
+		std::string command;
+		if(!(in >> command) || command[0] == '#') {
+			continue;
+		}
+		Entry entry;
+		entry.is_frame = false;
+		memset(&entry.event, 0, sizeof(entry.event));
+		SDL_Event & event = entry.event;
+		if(command == "frame") {
+			entry.is_frame = true;
+		} else if(command == "key") {
+			std::string key, mod = "0";
+			in >> key >> mod;
+			event.type = SDL_KEYDOWN;
+			event.key.state = SDL_PRESSED;
+			event.key.keysym.sym = parse_key(key);
+			event.key.keysym.mod = strtol(mod.c_str(), 0, 0);
+		} else if(command == "press") {
+			in >> mouse_x >> mouse_y;
+			event.type = SDL_MOUSEBUTTONDOWN;
+			event.button.button = SDL_BUTTON_LEFT;
+			event.button.state = SDL_PRESSED;
+			event.button.x = mouse_x;
+			event.button.y = mouse_y;
+		} else if(command == "release") {
+			event.type = SDL_MOUSEBUTTONUP;
+			event.button.button = SDL_BUTTON_LEFT;
+			event.button.state = SDL_RELEASED;
+			event.button.x = mouse_x;
+			event.button.y = mouse_y;
+		} else if(command == "move" || command == "moveby") {
+			int x = 0, y = 0;
+			in >> x >> y;
+			if(command == "moveby") {
+				x += mouse_x;
+				y += mouse_y;
+			}
+			event.type = SDL_MOUSEMOTION;
+			event.motion.state = SDL_BUTTON_LMASK;
+			event.motion.xrel = x - mouse_x;
+			event.motion.yrel = y - mouse_y;
+			event.motion.x = mouse_x = x;
+			event.motion.y = mouse_y = y;
+		} else if(command == "repeat") {
+			int count = 0;
+			in >> count;
+			repeat_starts.push_back(script.size());
+			repeat_counts.push_back(count);
+			continue;
+		} else if(command == "end") {
+			if(repeat_starts.empty()) {
+				std::cerr << filename << ":" << line_number << ": 'end' without 'repeat'." << std::endl;
+				return false;
+			}
+			size_t start = repeat_starts.back();
+			int count = repeat_counts.back();
+			repeat_starts.pop_back();
+			repeat_counts.pop_back();
+			std::vector<Entry> block(script.begin() + start, script.end());
+			script.erase(script.begin() + start, script.end());
+			for(int i = 0; i < count; ++i) {
+				script.insert(script.end(), block.begin(), block.end());
+			}
+			continue;
+		} else {
+			std::cerr << filename << ":" << line_number << ": unknown command '" << command << "'." << std::endl;
+			return false;
+		}
+		script.push_back(entry);
+	}
+	if(!repeat_starts.empty()) {
+		std::cerr << filename << ": 'repeat' without 'end'." << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool Recorder::open(const std::string & filename)
+{
+	file.open(filename.c_str());
+	has_events = false;
+	if(!file) {
+		std::cerr << "Cannot open '" << filename << "' for recording." << std::endl;
+		return false;
+	}
+	file << "# pixed session" << std::endl;
+	return true;
+}
+
+void Recorder::record(const SDL_Event & event)
+{
+	if(!file.is_open()) {
+		return;
+	}
+	switch(event.type) {
+		case SDL_KEYDOWN:
+			file << "key 0x" << std::hex << event.key.keysym.sym << " 0x" << event.key.keysym.mod << std::dec << '\n';
+			break;
+		case SDL_MOUSEBUTTONDOWN:
+			if(event.button.button != SDL_BUTTON_LEFT) {
+				return;
+			}
+			file << "press " << event.button.x << ' ' << event.button.y << '\n';
+			break;
+		case SDL_MOUSEBUTTONUP:
+			if(event.button.button != SDL_BUTTON_LEFT) {
+				return;
+			}
+			file << "release\n";
+			break;
+		case SDL_MOUSEMOTION:
+			if(!(event.motion.state & SDL_BUTTON_LMASK)) {
+				return;
+			}
+			file << "move " << event.motion.x << ' ' << event.motion.y << '\n';
+			break;
+		default:
+			return;
+	}
+	has_events = true;
+}
+
+void Recorder::frame()
+{
+	if(!file.is_open() || !has_events) {
+		return;
+	}
+	file << "frame\n";
+	has_events = false;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+class ReplayScript {
+public:
+	struct Entry {
+		bool is_frame;
+		SDL_Event event;
+	};
+	bool load(const std::string & filename);
+	const std::vector<Entry> & entries() const { return script; }
+private:
+	std::vector<Entry> script;
+};
+
+class Recorder {
+public:
+	bool open(const std::string & filename);
+	bool isOpen() const { return file.is_open(); }
+	void record(const SDL_Event & event);
+	void frame();
+private:
+	std::ofstream file;
+	bool has_events;
+};
@@ -0,0 +1,12 @@
+#include "sprite.h"
+
+SDL_Texture * Sprite::create_texture(SDL_Renderer * renderer, const Image & image)
+{
+	SDL_Texture * result = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, image.width, image.height);
+	if(!result) {
+		return 0;
+	}
+	SDL_UpdateTexture(result, 0, image.pixels, image.width * sizeof(Uint32));
+	SDL_SetTextureBlendMode(result, SDL_BLENDMODE_BLEND);
+	return result;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <SDL2/SDL.h>
+
+// Built-in images are decoded from res/*.xpm at build time into tmp/sprites.h,
+// where each file becomes Sprite::Image constant with the same name as the file (e.g. Sprite::font).
+namespace Sprite {
+
+struct Image {
+	int width, height;
+	const Uint32 * pixels; // ARGB8888, row by row.
+};
+
+SDL_Texture * create_texture(SDL_Renderer * renderer, const Image & image);
+
+}
@@ -0,0 +1,110 @@
+#include "stroke.h"
+#include <algorithm>
+#include <cstdlib>
+
+void Stroke::begin(const Chthon::Point & pos)
+{
+	active = true;
+	has_last = false;
+	points.clear();
+	points.push_back(pos);
+}
+
+void Stroke::addPoint(const Chthon::Point & pos)
+{
+	if(!active) {
+		begin(pos);
+		return;
+	}
+	if(!points.empty() && points.back() == pos) {
+		return;
+	}
+	points.push_back(pos);
+}
+
+void Stroke::end()
+{
+	active = false;
+}
+
+struct Bounds {
+	int left, top, right, bottom;
+	Bounds() : left(0), top(0), right(-1), bottom(-1) {}
+	void add(int x, int y)
+	{
+		if(right < left) {
+			left = right = x;
+			top = bottom = y;
+			return;
+		}
+		left = std::min(left, x);
+		right = std::max(right, x);
+		top = std::min(top, y);
+		bottom = std::max(bottom, y);
+	}
+};
+
+void plot(Image & canvas, int color, int x, int y, int row_limit, Bounds & bounds, std::vector<Chthon::Point> & written, std::vector<int> & previous)
+{
+	if(!canvas.pixels.valid(x, y) || y >= row_limit) {
+		return;
+	}
+	int value = canvas.pixels.get(x, y);
+	if(value == color) {
+		return;
+	}
+	previous.push_back(value);
+	canvas.pixels.set(x, y, color);
+	bounds.add(x, y);
+	written.push_back(Chthon::Point(x, y));
+}
+
+void draw_segment(Image & canvas, int color, const Chthon::Point & a, const Chthon::Point & b, int row_limit, Bounds & bounds, std::vector<Chthon::Point> & written, std::vector<int> & previous)
+{
+	int dx = std::abs(b.x - a.x);
+	int dy = -std::abs(b.y - a.y);
+	int step_x = a.x < b.x ? 1 : -1;
+	int step_y = a.y < b.y ? 1 : -1;
+	int error = dx + dy;
+	int x = a.x;
+	int y = a.y;
+	while(true) {
+		plot(canvas, color, x, y, row_limit, bounds, written, previous);
+		if(x == b.x && y == b.y) {
+			break;
+		}
+		int error2 = 2 * error;
+		if(error2 >= dy) {
+			error += dy;
+			x += step_x;
+		}
+		if(error2 <= dx) {
+			error += dx;
+			y += step_y;
+		}
+	}
+}
+
+SDL_Rect Stroke::apply(Image & canvas, int color, int row_limit)
+{
+	Bounds bounds;
+	written.clear();
+	previous.clear();
+	for(const Chthon::Point & point : points) {
+		if(has_last) {
+			draw_segment(canvas, color, last, point, row_limit, bounds, written, previous);
+		} else {
+			plot(canvas, color, point.x, point.y, row_limit, bounds, written, previous);
+		}
+		last = point;
+		has_last = true;
+	}
+	points.clear();
+
+	SDL_Rect result;
+	result.x = bounds.left;
+	result.y = bounds.top;
+	result.w = bounds.right - bounds.left + 1;
+	result.h = bounds.bottom - bounds.top + 1;
+	return result;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "image.h"
+#include <chthon2/pixmap.h>
+#include <chthon2/point.h>
+#include <SDL2/SDL.h>
+#include <vector>
+
+class Stroke {
+public:
+	Stroke() : active(false), has_last(false) {}
+	void begin(const Chthon::Point & pos);
+	void addPoint(const Chthon::Point & pos);
+	void end();
+	bool isActive() const { return active; }
+	bool hasPending() const { return !points.empty(); }
+	const Chthon::Point & lastPoint() const { return last; }
+	// Only rows above row_limit are changed.
+	SDL_Rect apply(Image & canvas, int color, int row_limit);
+	// Pixels changed by the last apply() and their values before it.
+	const std::vector<Chthon::Point> & writtenPixels() const { return written; }
+	const std::vector<int> & previousValues() const { return previous; }
+private:
+	bool active;
+	bool has_last;
+	Chthon::Point last;
+	std::vector<Chthon::Point> points;
+	std::vector<Chthon::Point> written;
+	std::vector<int> previous;
+};
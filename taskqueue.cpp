@@ -0,0 +1,54 @@
+#include "taskqueue.h"
+
+TaskQueue::~TaskQueue()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	changed.notify_all();
+	if(worker.joinable()) {
+		worker.join();
+	}
+}
+
+void TaskQueue::push(const std::function<void()> & task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.push_back(task);
+		if(!worker.joinable()) {
+			worker = std::thread(&TaskQueue::run, this);
+		}
+	}
+	changed.notify_all();
+}
+
+void TaskQueue::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while(busy || !tasks.empty()) {
+		changed.wait(lock);
+	}
+}
+
+void TaskQueue::run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while(true) {
+		while(tasks.empty() && !stopping) {
+			changed.wait(lock);
+		}
+		if(tasks.empty()) {
+			return;
+		}
+		std::function<void()> task = tasks.front();
+		tasks.pop_front();
+		busy = true;
+		lock.unlock();
+		task();
+		lock.lock();
+		busy = false;
+		changed.notify_all();
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Runs tasks one after another in order of pushing on a single background thread.
+// Thread is started on first push; destructor waits for all pushed tasks to finish.
+class TaskQueue {
+public:
+	TaskQueue() : busy(false), stopping(false) {}
+	~TaskQueue();
+	void push(const std::function<void()> & task);
+	void wait();
+private:
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<std::function<void()> > tasks;
+	bool busy;
+	bool stopping;
+
+	void run();
+	TaskQueue(const TaskQueue &);
+	TaskQueue & operator=(const TaskQueue &);
+};
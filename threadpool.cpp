@@ -0,0 +1,107 @@
+#include "threadpool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threads)
+	: current(0), remaining(0), generation(0), stopping(false)
+{
+	if(threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	for(unsigned i = 0; i < threads; ++i) {
+		queues.push_back(std::unique_ptr<Queue>(new Queue));
+	}
+	for(unsigned i = 0; i < threads; ++i) {
+		workers.push_back(std::thread(&ThreadPool::work, this, i));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for(std::thread & worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t)> & task)
+{
+	if(count == 0) {
+		return;
+	}
+	std::lock_guard<std::mutex> run_lock(run_mutex);
+	std::unique_lock<std::mutex> lock(mutex);
+	current = &task;
+	remaining = count;
+	// Consecutive indices go to the same worker, as neighbour tasks usually touch neighbour data.
+	size_t per_worker = (count + queues.size() - 1) / queues.size();
+	for(size_t i = 0; i < queues.size(); ++i) {
+		std::lock_guard<std::mutex> queue_lock(queues[i]->mutex);
+		for(size_t index = i * per_worker; index < count && index < (i + 1) * per_worker; ++index) {
+			queues[i]->tasks.push_back(index);
+		}
+	}
+	++generation;
+	wake.notify_all();
+	while(remaining > 0) {
+		done.wait(lock);
+	}
+	current = 0;
+}
+
+bool ThreadPool::take(unsigned id, size_t & index)
+{
+	{
+		Queue & own = *queues[id];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if(!own.tasks.empty()) {
+			index = own.tasks.back();
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+	for(size_t i = 1; i < queues.size(); ++i) {
+		Queue & other = *queues[(id + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(other.mutex);
+		if(!other.tasks.empty()) {
+			index = other.tasks.front();
+			other.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::work(unsigned id)
+{
+	unsigned long seen_generation = 0;
+	while(true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while(!stopping && generation == seen_generation) {
+				wake.wait(lock);
+			}
+			if(stopping) {
+				return;
+			}
+			seen_generation = generation;
+		}
+		size_t index = 0;
+		while(take(id, index)) {
+			// Queues hold only tasks of the current run, so current stays valid until they are done.
+			const std::function<void(size_t)> * task = 0;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				task = current;
+			}
+			(*task)(index);
+			std::lock_guard<std::mutex> lock(mutex);
+			if(--remaining == 0) {
+				done.notify_all();
+			}
+		}
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads with a task queue per worker.
+// Workers take tasks from the back of their own queue and steal from the front of others' when it is empty.
+class ThreadPool {
+public:
+	// Zero means one thread per hardware thread.
+	explicit ThreadPool(unsigned threads = 0);
+	~ThreadPool();
+	unsigned size() const { return workers.size(); }
+	// Calls task(i) for every i in [0, count) on pool threads and waits until all calls are finished.
+	// Task must not throw.
+	void run(size_t count, const std::function<void(size_t)> & task);
+private:
+	struct Queue {
+		std::mutex mutex;
+		std::deque<size_t> tasks;
+	};
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<Queue> > queues;
+	std::mutex run_mutex;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function<void(size_t)> * current;
+	size_t remaining;
+	unsigned long generation;
+	bool stopping;
+
+	void work(unsigned id);
+	bool take(unsigned id, size_t & index);
+	ThreadPool(const ThreadPool &);
+	ThreadPool & operator=(const ThreadPool &);
+};
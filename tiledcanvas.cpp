@@ -0,0 +1,367 @@
+#include "tiledcanvas.h"
+#include <algorithm>
+
+// Operations on packed rows for one index width.
+struct TileCodec {
+	int bits;
+	int words_per_row;
+	unsigned max_value;
+	unsigned (*get)(const uint32_t * row, int x);
+	void (*set)(uint32_t * row, int x, unsigned value);
+	void (*read)(const uint32_t * row, int x, int count, int * values);
+	void (*write)(uint32_t * row, int x, int count, const int * values);
+	void (*fill)(uint32_t * row, int x, int count, unsigned value);
+	// First x from start to end (exclusive) with given step which value is equal (or not) to given one, or end.
+	int (*find)(const uint32_t * row, int start, int end, int step, unsigned value, bool equal);
+	// Word filled with given value.
+	uint32_t (*pattern)(unsigned value);
+};
+
+namespace {
+
+template<int BITS>
+struct Packing {
+	static const int PER_WORD = 32 / BITS;
+	static const uint32_t MASK = uint32_t(~0ull >> (64 - BITS));
+	static const int SHIFT = BITS % 32; // Next value in word; never used for 32-bit values.
+
+	static unsigned get(const uint32_t * row, int x)
+	{
+		return (row[x / PER_WORD] >> (x % PER_WORD * BITS)) & MASK;
+	}
+	static void set(uint32_t * row, int x, unsigned value)
+	{
+		int shift = x % PER_WORD * BITS;
+		uint32_t & word = row[x / PER_WORD];
+		word = (word & ~(MASK << shift)) | (uint32_t(value) << shift);
+	}
+	static void read(const uint32_t * row, int x, int count, int * values)
+	{
+		int end = x + count;
+		while(x < end) {
+			uint32_t word = row[x / PER_WORD] >> (x % PER_WORD * BITS);
+			int stop = std::min(end, (x / PER_WORD + 1) * PER_WORD);
+			for(; x < stop; ++x, word >>= SHIFT) {
+				*values++ = word & MASK;
+			}
+		}
+	}
+	static void write(uint32_t * row, int x, int count, const int * values)
+	{
+		int end = x + count;
+		while(x < end && x % PER_WORD != 0) {
+			set(row, x++, *values++);
+		}
+		for(; x + PER_WORD <= end; x += PER_WORD) {
+			uint32_t word = 0;
+			for(int i = 0; i < PER_WORD; ++i) {
+				word |= uint32_t(*values++) << (i * BITS % 32);
+			}
+			row[x / PER_WORD] = word;
+		}
+		while(x < end) {
+			set(row, x++, *values++);
+		}
+	}
+	static void fill(uint32_t * row, int x, int count, unsigned value)
+	{
+		int end = x + count;
+		while(x < end && x % PER_WORD != 0) {
+			set(row, x++, value);
+		}
+		uint32_t word = pattern(value);
+		for(; x + PER_WORD <= end; x += PER_WORD) {
+			row[x / PER_WORD] = word;
+		}
+		while(x < end) {
+			set(row, x++, value);
+		}
+	}
+	static int find(const uint32_t * row, int start, int end, int step, unsigned value, bool equal)
+	{
+		for(int x = start; x != end; x += step) {
+			if((get(row, x) == value) == equal) {
+				return x;
+			}
+		}
+		return end;
+	}
+	static uint32_t pattern(unsigned value)
+	{
+		return uint32_t(value) * (0xffffffffu / MASK);
+	}
+	static const TileCodec * codec()
+	{
+		static const TileCodec result = {
+			BITS, TiledCanvas::TILE_SIZE / PER_WORD, MASK,
+			&get, &set, &read, &write, &fill, &find, &pattern,
+		};
+		return &result;
+	}
+};
+
+// Narrowest codec that fits given value.
+const TileCodec * codec_for(unsigned value)
+{
+	if(value <= Packing<1>::MASK) {
+		return Packing<1>::codec();
+	} else if(value <= Packing<2>::MASK) {
+		return Packing<2>::codec();
+	} else if(value <= Packing<4>::MASK) {
+		return Packing<4>::codec();
+	} else if(value <= Packing<8>::MASK) {
+		return Packing<8>::codec();
+	} else if(value <= Packing<16>::MASK) {
+		return Packing<16>::codec();
+	}
+	return Packing<32>::codec();
+}
+
+}
+
+const int TiledCanvas::TILE_SIZE;
+
+TiledCanvas::TiledCanvas(unsigned width, unsigned height, int value)
+	: image_width(width), image_height(height),
+	tiles_x((width + TILE_SIZE - 1) / TILE_SIZE),
+	codec(codec_for(value)),
+	tiles(tiles_x * ((height + TILE_SIZE - 1) / TILE_SIZE), Tile(value))
+{
+}
+
+uint32_t * TiledCanvas::row(Tile & tile, int y) const
+{
+	return tile.words.data() + (y % TILE_SIZE) * codec->words_per_row;
+}
+
+const uint32_t * TiledCanvas::row(const Tile & tile, int y) const
+{
+	return tile.words.data() + (y % TILE_SIZE) * codec->words_per_row;
+}
+
+void TiledCanvas::densify(Tile & tile)
+{
+	tile.touched = true;
+	if(tile.words.empty()) {
+		tile.words.assign(TILE_SIZE * codec->words_per_row, codec->pattern(tile.value));
+	}
+}
+
+void TiledCanvas::fit(unsigned value)
+{
+	if(value > codec->max_value) {
+		repack(codec_for(value));
+	}
+}
+
+void TiledCanvas::repack(const TileCodec * new_codec)
+{
+	int values[TILE_SIZE];
+	std::vector<uint32_t> words;
+	for(Tile & tile : tiles) {
+		if(tile.words.empty()) {
+			continue;
+		}
+		words.assign(TILE_SIZE * new_codec->words_per_row, 0);
+		for(int y = 0; y < TILE_SIZE; ++y) {
+			codec->read(tile.words.data() + y * codec->words_per_row, 0, TILE_SIZE, values);
+			new_codec->write(words.data() + y * new_codec->words_per_row, 0, TILE_SIZE, values);
+		}
+		tile.words.swap(words);
+		words = std::vector<uint32_t>();
+	}
+	codec = new_codec;
+}
+
+void TiledCanvas::setColorCount(size_t colors)
+{
+	const TileCodec * new_codec = codec_for(colors > 0 ? unsigned(colors - 1) : 0);
+	if(new_codec != codec) {
+		repack(new_codec);
+	}
+}
+
+int TiledCanvas::indexBits() const
+{
+	return codec->bits;
+}
+
+int TiledCanvas::get(int x, int y) const
+{
+	const Tile & tile = tileAt(x, y);
+	if(tile.words.empty()) {
+		return tile.value;
+	}
+	return codec->get(row(tile, y), x % TILE_SIZE);
+}
+
+void TiledCanvas::set(int x, int y, int value)
+{
+	fit(value);
+	Tile & tile = tileAt(x, y);
+	if(tile.words.empty() && tile.value == unsigned(value)) {
+		return;
+	}
+	densify(tile);
+	codec->set(row(tile, y), x % TILE_SIZE, value);
+}
+
+void TiledCanvas::readSpan(int x, int y, int count, int * values) const
+{
+	while(count > 0) {
+		const Tile & tile = tileAt(x, y);
+		int length = std::min(count, TILE_SIZE - x % TILE_SIZE);
+		if(tile.words.empty()) {
+			std::fill(values, values + length, int(tile.value));
+		} else {
+			codec->read(row(tile, y), x % TILE_SIZE, length, values);
+		}
+		x += length;
+		values += length;
+		count -= length;
+	}
+}
+
+void TiledCanvas::writeSpan(int x, int y, int count, const int * values)
+{
+	if(count <= 0) {
+		return;
+	}
+	fit(unsigned(*std::max_element(values, values + count, [](int a, int b) { return unsigned(a) < unsigned(b); })));
+	while(count > 0) {
+		Tile & tile = tileAt(x, y);
+		int length = std::min(count, TILE_SIZE - x % TILE_SIZE);
+		bool same = tile.words.empty() && std::find_if(values, values + length, [&tile](int value) { return unsigned(value) != tile.value; }) == values + length;
+		if(!same) {
+			densify(tile);
+			codec->write(row(tile, y), x % TILE_SIZE, length, values);
+		}
+		x += length;
+		values += length;
+		count -= length;
+	}
+}
+
+void TiledCanvas::fillSpan(int x, int y, int count, int value)
+{
+	fit(value);
+	while(count > 0) {
+		Tile & tile = tileAt(x, y);
+		int length = std::min(count, TILE_SIZE - x % TILE_SIZE);
+		if(!tile.words.empty() || tile.value != unsigned(value)) {
+			densify(tile);
+			codec->fill(row(tile, y), x % TILE_SIZE, length, value);
+		}
+		x += length;
+		count -= length;
+	}
+}
+
+int TiledCanvas::scanRight(int x, int y, int end, int value, bool equal) const
+{
+	while(x < end) {
+		const Tile & tile = tileAt(x, y);
+		int base = x - x % TILE_SIZE;
+		int segment_end = std::min(end, base + TILE_SIZE);
+		if(tile.words.empty()) {
+			if((tile.value == unsigned(value)) == equal) {
+				return x;
+			}
+		} else {
+			int found = codec->find(row(tile, y), x - base, segment_end - base, 1, value, equal);
+			if(found != segment_end - base) {
+				return base + found;
+			}
+		}
+		x = segment_end;
+	}
+	return end;
+}
+
+int TiledCanvas::scanLeft(int x, int y, int end, int value, bool equal) const
+{
+	while(x > end) {
+		const Tile & tile = tileAt(x, y);
+		int base = x - x % TILE_SIZE;
+		int segment_end = std::max(end, base - 1);
+		if(tile.words.empty()) {
+			if((tile.value == unsigned(value)) == equal) {
+				return x;
+			}
+		} else {
+			int found = codec->find(row(tile, y), x - base, segment_end - base, -1, value, equal);
+			if(found != segment_end - base) {
+				return base + found;
+			}
+		}
+		x = segment_end;
+	}
+	return end;
+}
+
+void TiledCanvas::countValues(int top, int bottom, std::vector<unsigned> & histogram) const
+{
+	size_t colors = histogram.size();
+	int values[TILE_SIZE];
+	for(int tile_top = top - top % TILE_SIZE; tile_top < bottom; tile_top += TILE_SIZE) {
+		int first = std::max(top, tile_top);
+		int last = std::min(bottom, tile_top + TILE_SIZE);
+		for(int tile_left = 0; tile_left < int(image_width); tile_left += TILE_SIZE) {
+			const Tile & tile = tileAt(tile_left, tile_top);
+			int columns = std::min(TILE_SIZE, int(image_width) - tile_left);
+			if(tile.words.empty()) {
+				if(tile.value < colors) {
+					histogram[tile.value] += unsigned(columns * (last - first));
+				}
+				continue;
+			}
+			for(int y = first; y < last; ++y) {
+				codec->read(row(tile, y), 0, columns, values);
+				for(int x = 0; x < columns; ++x) {
+					if(unsigned(values[x]) < colors) {
+						++histogram[values[x]];
+					}
+				}
+			}
+		}
+	}
+}
+
+void TiledCanvas::compact()
+{
+	for(size_t i = 0; i < tiles.size(); ++i) {
+		Tile & tile = tiles[i];
+		if(!tile.touched) {
+			continue;
+		}
+		tile.touched = false;
+		if(tile.words.empty()) {
+			continue;
+		}
+		int columns = std::min<int>(TILE_SIZE, image_width - (i % tiles_x) * TILE_SIZE);
+		int rows = std::min<int>(TILE_SIZE, image_height - (i / tiles_x) * TILE_SIZE);
+		unsigned value = codec->get(tile.words.data(), 0);
+		bool uniform = true;
+		if(columns == TILE_SIZE && rows == TILE_SIZE) {
+			uint32_t word = codec->pattern(value);
+			uniform = std::find_if(tile.words.begin(), tile.words.end(), [word](uint32_t w) { return w != word; }) == tile.words.end();
+		} else {
+			for(int y = 0; uniform && y < rows; ++y) {
+				uniform = codec->find(tile.words.data() + y * codec->words_per_row, 0, columns, 1, value, false) == columns;
+			}
+		}
+		if(uniform) {
+			tile.value = value;
+			tile.words = std::vector<uint32_t>();
+		}
+	}
+}
+
+size_t TiledCanvas::memoryUsage() const
+{
+	size_t result = sizeof(*this) + tiles.capacity() * sizeof(Tile);
+	for(const Tile & tile : tiles) {
+		result += tile.words.capacity() * sizeof(uint32_t);
+	}
+	return result;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct TileCodec;
+
+// Pixel indices of an image split into square tiles.
+// Tile of a single value keeps only that value; other tiles keep rows packed with the smallest index width
+// (1, 2, 4, 8, 16 or 32 bits) that fits every palette entry, so memory follows image content and palette size rather than image area.
+// Pixels are accessed one by one or by horizontal spans; spans are processed a tile segment at a time.
+// Spans must lie within the image.
+// Reading is thread-safe; concurrent writes are safe only when they go to different rows of tiles
+// and their values fit current index width.
+class TiledCanvas {
+public:
+	static const int TILE_SIZE = 64;
+
+	explicit TiledCanvas(unsigned width = 1, unsigned height = 1, int value = 0);
+	unsigned width() const { return image_width; }
+	unsigned height() const { return image_height; }
+	bool valid(int x, int y) const { return x >= 0 && y >= 0 && unsigned(x) < image_width && unsigned(y) < image_height; }
+
+	int get(int x, int y) const;
+	void set(int x, int y, int value);
+	void readSpan(int x, int y, int count, int * values) const;
+	void writeSpan(int x, int y, int count, const int * values);
+	void fillSpan(int x, int y, int count, int value);
+	// First column of row y in [x, end) going right, or in (end, x] going left,
+	// which value is equal (or not equal) to given one; end if there is none. Uniform tiles are skipped at once.
+	int scanRight(int x, int y, int end, int value, bool equal) const;
+	int scanLeft(int x, int y, int end, int value, bool equal) const;
+	// Adds counts of pixels in rows [top, bottom) to histogram; values outside of it are ignored.
+	void countValues(int top, int bottom, std::vector<unsigned> & histogram) const;
+
+	// Picks index width for palette of given size. Every pixel must be below it.
+	// Writing larger value widens indices by itself.
+	void setColorCount(size_t colors);
+	int indexBits() const;
+	// Widens indices so that value can be written; done before concurrent writes.
+	void fit(unsigned value);
+	// Turns tiles that were written since last call and have become uniform back into single values.
+	void compact();
+	size_t memoryUsage() const;
+private:
+	struct Tile {
+		unsigned value; // Value of every pixel while words are empty.
+		bool touched;
+		std::vector<uint32_t> words; // Packed rows, TILE_SIZE pixels each.
+		Tile(unsigned tile_value = 0) : value(tile_value), touched(false) {}
+	};
+	unsigned image_width, image_height;
+	int tiles_x;
+	const TileCodec * codec;
+	std::vector<Tile> tiles;
+
+	Tile & tileAt(int x, int y) { return tiles[(y / TILE_SIZE) * tiles_x + x / TILE_SIZE]; }
+	const Tile & tileAt(int x, int y) const { return tiles[(y / TILE_SIZE) * tiles_x + x / TILE_SIZE]; }
+	uint32_t * row(Tile & tile, int y) const;
+	const uint32_t * row(const Tile & tile, int y) const;
+	void densify(Tile & tile);
+	void repack(const TileCodec * new_codec);
+};
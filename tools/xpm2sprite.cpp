@@ -0,0 +1,80 @@
+#include <chthon2/pixmap.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <cstdio>
+
+// Writes C++ header with decoded pixels of given XPM files for sprite.h.
+// Usage: xpm2sprite FILE.xpm... > sprites.h
+
+std::string sprite_name(const std::string & filename)
+{
+	size_t begin = filename.find_last_of('/');
+	begin = (begin == std::string::npos) ? 0 : begin + 1;
+	size_t end = filename.find('.', begin);
+	std::string name = filename.substr(begin, end - begin);
+	for(char & c : name) {
+		if(!isalnum((unsigned char)c)) {
+			c = '_';
+		}
+	}
+	return name;
+}
+
+unsigned to_argb(const Chthon::Color & color)
+{
+	if(Chthon::is_transparent(color)) {
+		return 0;
+	}
+	return 0xff000000
+		| (unsigned(Chthon::get_red(color)) << 16)
+		| (unsigned(Chthon::get_green(color)) << 8)
+		| unsigned(Chthon::get_blue(color));
+}
+
+bool write_sprite(const std::string & filename)
+{
+	std::ifstream file(filename.c_str());
+	if(!file) {
+		std::cerr << "Cannot read " << filename << std::endl;
+		return false;
+	}
+	std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	Chthon::Pixmap pixmap;
+	try {
+		pixmap.load(data);
+	} catch(const Chthon::Pixmap::Exception & e) {
+		std::cerr << filename << ": " << e.what << std::endl;
+		return false;
+	}
+	std::string name = sprite_name(filename);
+	unsigned width = pixmap.pixels.width();
+	unsigned height = pixmap.pixels.height();
+	std::cout << "static const Uint32 " << name << "_pixels[] = {\n";
+	for(unsigned y = 0; y < height; ++y) {
+		for(unsigned x = 0; x < width; ++x) {
+			char value[16];
+			snprintf(value, sizeof(value), "0x%08x,", to_argb(pixmap.palette[pixmap.pixels.cell(x, y)]));
+			std::cout << ((x % 8 == 0) ? "\t" : " ") << value;
+			if(x % 8 == 7 || x + 1 == width) {
+				std::cout << '\n';
+			}
+		}
+	}
+	std::cout << "};\n";
+	std::cout << "const Image " << name << " = { " << width << ", " << height << ", " << name << "_pixels };\n\n";
+	return true;
+}
+
+int main(int argc, char ** argv)
+{
+	std::cout << "// Generated by tools/xpm2sprite, do not edit.\n";
+	std::cout << "#pragma once\n#include \"../sprite.h\"\n\nnamespace Sprite {\n\n";
+	for(int i = 1; i < argc; ++i) {
+		if(!write_sprite(argv[i])) {
+			return 1;
+		}
+	}
+	std::cout << "}\n";
+	return 0;
+}
@@ -0,0 +1,447 @@
+#include "xpmcache.h"
+#include "mappedfile.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Cache is never moved to another machine, so native byte order is used.
+const char CACHE_MAGIC[4] = { 'P', 'X', 'C', '1' };
+// Total size of cache files; least recently used ones are removed above it.
+const unsigned long long CACHE_SIZE_LIMIT = 1ULL << 30;
+
+struct CacheHeader {
+	char magic[4];
+	uint32_t index_size;
+	uint64_t file_size;
+	int64_t mtime_sec, mtime_nsec;
+	uint32_t width, height, colors, path_length;
+};
+
+static bool cache_enabled = true;
+
+void disable_xpm_cache()
+{
+	cache_enabled = false;
+}
+
+namespace {
+
+struct FileKey {
+	std::string path;
+	unsigned long long size;
+	long long mtime_sec, mtime_nsec;
+};
+
+bool get_file_key(const std::string & filename, FileKey & key)
+{
+	char path[PATH_MAX];
+	struct stat st;
+	if(!realpath(filename.c_str(), path) || stat(path, &st) != 0) {
+		return false;
+	}
+	key.path = path;
+	key.size = st.st_size;
+	key.mtime_sec = st.st_mtim.tv_sec;
+	key.mtime_nsec = st.st_mtim.tv_nsec;
+	return true;
+}
+
+std::string cache_directory()
+{
+	const char * xdg_cache = getenv("XDG_CACHE_HOME");
+	std::string root;
+	if(xdg_cache && *xdg_cache) {
+		root = xdg_cache;
+	} else {
+		const char * home = getenv("HOME");
+		if(!home || !*home) {
+			return std::string();
+		}
+		root = std::string(home) + "/.cache";
+	}
+	mkdir(root.c_str(), 0700);
+	std::string dir = root + "/pixed";
+	mkdir(dir.c_str(), 0700);
+	return dir;
+}
+
+std::string cache_filename(const std::string & path)
+{
+	if(!cache_enabled) {
+		return std::string();
+	}
+	std::string dir = cache_directory();
+	if(dir.empty()) {
+		return std::string();
+	}
+	uint64_t hash = 14695981039346656037ULL;
+	for(char c : path) {
+		hash = (hash ^ (unsigned char)c) * 1099511628211ULL;
+	}
+	char name[32];
+	snprintf(name, sizeof(name), "/%016llx.cache", (unsigned long long)hash);
+	return dir + name;
+}
+
+bool same_key(const CacheHeader & header, const FileKey & key)
+{
+	return header.file_size == key.size && header.mtime_sec == key.mtime_sec && header.mtime_nsec == key.mtime_nsec;
+}
+
+// Cache of a file that is gone or has changed since is of no use.
+bool is_stale(const std::string & cache)
+{
+	std::ifstream in(cache.c_str(), std::ios::binary);
+	CacheHeader header;
+	if(!in.read((char*)&header, sizeof(header)) || memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) {
+		return true;
+	}
+	std::string path(header.path_length, '\0');
+	if(!in.read(&path[0], path.size())) {
+		return true;
+	}
+	FileKey key;
+	return !get_file_key(path, key) || key.path != path || !same_key(header, key);
+}
+
+// Removes stale cache files, then least recently used ones until total size fits the limit.
+// Cache that is just written is kept even if it alone exceeds the limit.
+void prune_cache(const std::string & dir, const std::string & keep)
+{
+	DIR * handle = opendir(dir.c_str());
+	if(!handle) {
+		return;
+	}
+	struct Entry {
+		std::string filename;
+		unsigned long long size;
+		long long used;
+	};
+	std::vector<Entry> entries;
+	unsigned long long total = 0;
+	while(dirent * item = readdir(handle)) {
+		std::string name = item->d_name;
+		if(name.size() < 6 || name.compare(name.size() - 6, 6, ".cache") != 0) {
+			continue;
+		}
+		Entry entry;
+		entry.filename = dir + "/" + name;
+		struct stat st;
+		if(stat(entry.filename.c_str(), &st) != 0) {
+			continue;
+		}
+		if(entry.filename != keep && is_stale(entry.filename)) {
+			unlink(entry.filename.c_str());
+			continue;
+		}
+		entry.size = st.st_size;
+		entry.used = st.st_mtime;
+		total += entry.size;
+		entries.push_back(entry);
+	}
+	closedir(handle);
+	std::sort(entries.begin(), entries.end(), [](const Entry & a, const Entry & b) { return a.used < b.used; });
+	for(const Entry & entry : entries) {
+		if(total <= CACHE_SIZE_LIMIT) {
+			break;
+		}
+		if(entry.filename != keep && unlink(entry.filename.c_str()) == 0) {
+			total -= entry.size;
+		}
+	}
+}
+
+unsigned index_size_for(size_t colors)
+{
+	if(colors <= 0x100) {
+		return 1;
+	} else if(colors <= 0x10000) {
+		return 2;
+	}
+	return 4;
+}
+
+class CacheInput {
+public:
+	CacheInput(const char * data_begin, const char * data_end) : pos(data_begin), end(data_end) {}
+	const char * take(size_t size)
+	{
+		if(size_t(end - pos) < size) {
+			return 0;
+		}
+		const char * result = pos;
+		pos += size;
+		return result;
+	}
+	template<class T>
+	bool read(T & value)
+	{
+		const char * data = take(sizeof(T));
+		if(data) {
+			memcpy(&value, data, sizeof(T));
+		}
+		return data != 0;
+	}
+	bool read(XpmSpan & span)
+	{
+		uint64_t values[2];
+		if(!read(values)) {
+			return false;
+		}
+		span.begin = values[0];
+		span.end = values[1];
+		return true;
+	}
+	bool read(std::string & text)
+	{
+		uint64_t size;
+		const char * data = read(size) ? take(size) : 0;
+		if(data) {
+			text.assign(data, size);
+		}
+		return data != 0;
+	}
+private:
+	const char * pos;
+	const char * end;
+};
+
+template<class T>
+bool read_indices(const char * data, Image & image)
+{
+	int width = image.pixels.width();
+	int height = image.pixels.height();
+	unsigned colors = image.palette.size();
+	std::vector<T> row(width);
+	std::vector<int> values(width);
+	T max_index = 0;
+	for(int y = 0; y < height; ++y) {
+		memcpy(&row[0], data + size_t(y) * width * sizeof(T), width * sizeof(T));
+		for(int x = 0; x < width; ++x) {
+			max_index = std::max(max_index, row[x]);
+			values[x] = row[x];
+		}
+		if(max_index >= colors) {
+			return false;
+		}
+		image.pixels.writeSpan(0, y, width, values.data());
+		if(y % TiledCanvas::TILE_SIZE == TiledCanvas::TILE_SIZE - 1) {
+			image.pixels.compact();
+		}
+	}
+	image.pixels.compact();
+	return true;
+}
+
+template<class T>
+void write_indices(const int * values, size_t count, char * out)
+{
+	for(size_t i = 0; i < count; ++i) {
+		T value = T(values[i]);
+		memcpy(out + i * sizeof(T), &value, sizeof(T));
+	}
+}
+
+void write_span(std::ostream & out, const XpmSpan & span)
+{
+	uint64_t values[2] = { span.begin, span.end };
+	out.write((const char*)values, sizeof(values));
+}
+
+void write_text(std::ostream & out, const std::string & text)
+{
+	uint64_t size = text.size();
+	out.write((const char*)&size, sizeof(size));
+	out.write(text.data(), text.size());
+}
+
+}
+
+bool read_xpm_cache(const std::string & filename, Image & image, XpmLayout & layout)
+{
+	FileKey key;
+	if(!get_file_key(filename, key)) {
+		return false;
+	}
+	std::string cache = cache_filename(key.path);
+	MappedFile file;
+	if(cache.empty() || !file.open(cache)) {
+		return false;
+	}
+	CacheInput in(file.begin(), file.end());
+	CacheHeader header;
+	if(!in.read(header) || memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) {
+		return false;
+	}
+	if(!same_key(header, key)) {
+		unlink(cache.c_str());
+		return false;
+	}
+	const char * path = in.take(header.path_length);
+	if(!path || std::string(path, header.path_length) != key.path) {
+		return false;
+	}
+	if(header.index_size != index_size_for(header.colors) || header.width == 0 || header.height == 0) {
+		return false;
+	}
+	const char * colors = in.take(header.colors * sizeof(int32_t));
+	const char * pixels = in.take(uint64_t(header.width) * header.height * header.index_size);
+	if(!colors || !pixels) {
+		return false;
+	}
+
+	XpmLayout result;
+	int32_t cpp;
+	uint64_t length;
+	if(!in.read(cpp) || !in.read(length) || !in.read(result.header) || !in.read(result.header_text)) {
+		return false;
+	}
+	result.cpp = cpp;
+	result.length = length;
+	result.colors.resize(header.colors);
+	result.rows.resize(header.height);
+	for(XpmSpan & span : result.colors) {
+		if(!in.read(span)) {
+			return false;
+		}
+	}
+	for(XpmSpan & span : result.rows) {
+		if(!in.read(span)) {
+			return false;
+		}
+	}
+	if(!in.read(result.codes) || result.length != key.size || result.codes.size() != size_t(cpp) * header.colors) {
+		return false;
+	}
+
+	image.palette.resize(header.colors);
+	for(unsigned i = 0; i < header.colors; ++i) {
+		int32_t color;
+		memcpy(&color, colors + i * sizeof(color), sizeof(color));
+		image.palette[i] = Chthon::Color(color);
+	}
+	image.pixels = TiledCanvas(header.width, header.height);
+	image.pixels.setColorCount(header.colors);
+	bool ok = false;
+	switch(header.index_size) {
+		case 1: ok = read_indices<uint8_t>(pixels, image); break;
+		case 2: ok = read_indices<uint16_t>(pixels, image); break;
+		case 4: ok = read_indices<uint32_t>(pixels, image); break;
+	}
+	if(ok) {
+		std::swap(layout, result);
+		// Modification time of cache marks its last use for pruning.
+		utimensat(AT_FDCWD, cache.c_str(), 0, 0);
+	}
+	return ok;
+}
+
+bool XpmCacheWriter::open(const std::string & xpm_filename, int image_width, int image_height, const std::vector<Chthon::Color> & palette)
+{
+	abandon();
+	FileKey key;
+	if(!get_file_key(xpm_filename, key)) {
+		return false;
+	}
+	cache_filename = ::cache_filename(key.path);
+	if(cache_filename.empty()) {
+		return false;
+	}
+	temp_filename = cache_filename + "." + std::to_string(getpid()) + ".tmp";
+	out.open(temp_filename.c_str(), std::ios::binary | std::ios::trunc);
+	if(!out) {
+		return false;
+	}
+	filename = key.path;
+	file_size = key.size;
+	mtime_sec = key.mtime_sec;
+	mtime_nsec = key.mtime_nsec;
+	width = image_width;
+	index_size = index_size_for(palette.size());
+
+	CacheHeader header;
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.index_size = index_size;
+	header.file_size = file_size;
+	header.mtime_sec = mtime_sec;
+	header.mtime_nsec = mtime_nsec;
+	header.width = image_width;
+	header.height = image_height;
+	header.colors = palette.size();
+	header.path_length = filename.size();
+	out.write((const char*)&header, sizeof(header));
+	out.write(filename.data(), filename.size());
+	for(const Chthon::Color & color : palette) {
+		int32_t value = int32_t(color);
+		out.write((const char*)&value, sizeof(value));
+	}
+	return bool(out);
+}
+
+void XpmCacheWriter::writeRows(const int * values, int rows)
+{
+	if(!out.is_open()) {
+		return;
+	}
+	size_t count = size_t(rows) * width;
+	buffer.resize(count * index_size);
+	switch(index_size) {
+		case 1: write_indices<uint8_t>(values, count, buffer.data()); break;
+		case 2: write_indices<uint16_t>(values, count, buffer.data()); break;
+		case 4: write_indices<uint32_t>(values, count, buffer.data()); break;
+	}
+	out.write(buffer.data(), buffer.size());
+}
+
+bool XpmCacheWriter::commit(const XpmLayout & layout)
+{
+	if(!out.is_open()) {
+		return false;
+	}
+	int32_t cpp = layout.cpp;
+	uint64_t length = layout.length;
+	out.write((const char*)&cpp, sizeof(cpp));
+	out.write((const char*)&length, sizeof(length));
+	write_span(out, layout.header);
+	write_text(out, layout.header_text);
+	for(const XpmSpan & span : layout.colors) {
+		write_span(out, span);
+	}
+	for(const XpmSpan & span : layout.rows) {
+		write_span(out, span);
+	}
+	write_text(out, layout.codes);
+	out.close();
+	// File could change while it was read.
+	FileKey key;
+	if(out.fail() || !get_file_key(filename, key) || key.size != file_size || key.mtime_sec != mtime_sec || key.mtime_nsec != mtime_nsec) {
+		abandon();
+		return false;
+	}
+	if(rename(temp_filename.c_str(), cache_filename.c_str()) != 0) {
+		abandon();
+		return false;
+	}
+	temp_filename.clear();
+	prune_cache(cache_filename.substr(0, cache_filename.rfind('/')), cache_filename);
+	return true;
+}
+
+void XpmCacheWriter::abandon()
+{
+	if(out.is_open()) {
+		out.close();
+	}
+	if(!temp_filename.empty()) {
+		unlink(temp_filename.c_str());
+		temp_filename.clear();
+	}
+	buffer.clear();
+}
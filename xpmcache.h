@@ -0,0 +1,35 @@
+#pragma once
+#include "xpmreader.h"
+#include <fstream>
+
+// Binary copy of decoded XPM file (palette, pixel indices and layout) in $XDG_CACHE_HOME/pixed/.
+// Cache is keyed by real path, size and modification time of the file, so it is ignored as soon as file changes.
+
+void disable_xpm_cache();
+
+// Fills image and layout from cache if there is up-to-date cache for the file.
+// Image may be left partially filled when cache turns out to be broken.
+bool read_xpm_cache(const std::string & filename, Image & image, XpmLayout & layout);
+
+// Writes cache as pixel rows are decoded; cache appears only after successful commit().
+class XpmCacheWriter {
+public:
+	XpmCacheWriter() : width(0), index_size(0) {}
+	~XpmCacheWriter() { abandon(); }
+	bool open(const std::string & filename, int width, int height, const std::vector<Chthon::Color> & palette);
+	bool isOpen() const { return out.is_open(); }
+	void writeRows(const int * values, int rows);
+	bool commit(const XpmLayout & layout);
+	void abandon();
+private:
+	std::ofstream out;
+	std::string cache_filename, temp_filename, filename;
+	std::vector<char> buffer;
+	int width;
+	unsigned index_size;
+	unsigned long long file_size;
+	long long mtime_sec, mtime_nsec;
+
+	XpmCacheWriter(const XpmCacheWriter &);
+	XpmCacheWriter & operator=(const XpmCacheWriter &);
+};
@@ -0,0 +1,607 @@
+#include "xpmdocument.h"
+#include "xpmcache.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+bool is_code_char(char ch)
+{
+	return ch >= ' ' && ch <= '~' && ch != '"' && ch != '\\';
+}
+
+// Picks first unused code of given width in printable range.
+bool make_code(const std::string & codes, int cpp, std::string & code)
+{
+	code.assign(cpp, ' ');
+	while(true) {
+		bool used = false;
+		for(size_t i = 0; i + cpp <= codes.size(); i += cpp) {
+			if(codes.compare(i, cpp, code) == 0) {
+				used = true;
+				break;
+			}
+		}
+		if(!used) {
+			return true;
+		}
+		int pos = cpp - 1;
+		while(pos >= 0) {
+			do {
+				++code[pos];
+			} while(code[pos] <= '~' && !is_code_char(code[pos]));
+			if(code[pos] <= '~') {
+				break;
+			}
+			code[pos] = ' ';
+			--pos;
+		}
+		if(pos < 0) {
+			return false;
+		}
+	}
+}
+
+std::string color_line(const char * code, int cpp, const Chthon::Color & color)
+{
+	if(Chthon::is_transparent(color)) {
+		return std::string(code, cpp) + " c None";
+	}
+	char spec[8];
+	snprintf(spec, sizeof(spec), "#%02x%02x%02x", Chthon::get_red(color), Chthon::get_green(color), Chthon::get_blue(color));
+	return std::string(code, cpp) + " c " + spec;
+}
+
+std::string format_xpm(const Image & image)
+{
+	std::string alphabet;
+	for(char ch = ' '; ch <= '~'; ++ch) {
+		if(is_code_char(ch)) {
+			alphabet += ch;
+		}
+	}
+	size_t colors = image.palette.size();
+	int cpp = 1;
+	for(size_t capacity = alphabet.size(); capacity < colors; capacity *= alphabet.size()) {
+		++cpp;
+	}
+	std::string codes(colors * cpp, ' ');
+	for(size_t i = 0; i < colors; ++i) {
+		size_t number = i;
+		for(int c = cpp - 1; c >= 0; --c) {
+			codes[i * cpp + c] = alphabet[number % alphabet.size()];
+			number /= alphabet.size();
+		}
+	}
+
+	int width = image.pixels.width();
+	int height = image.pixels.height();
+	char header[64];
+	snprintf(header, sizeof(header), "\"%d %d %u %d\"", width, height, unsigned(colors), cpp);
+	std::string text = "/* XPM */\nstatic char * image[] = {\n";
+	text += header;
+	for(size_t i = 0; i < colors; ++i) {
+		text += ",\n\"" + color_line(codes.data() + i * cpp, cpp, image.palette[i]) + "\"";
+	}
+	text.reserve(text.size() + size_t(height) * (size_t(width) * cpp + 4) + 4);
+	std::vector<int> row(width);
+	for(int y = 0; y < height; ++y) {
+		image.pixels.readSpan(0, y, width, row.data());
+		text += ",\n\"";
+		size_t begin = text.size();
+		text.resize(begin + size_t(width) * cpp);
+		char * out = &text[begin];
+		for(int x = 0; x < width; ++x, out += cpp) {
+			unsigned index = unsigned(row[x]) < colors ? row[x] : 0;
+			std::copy(codes.data() + index * cpp, codes.data() + (index + 1) * cpp, out);
+		}
+		text += "\"";
+	}
+	text += "};\n";
+	return text;
+}
+
+// Replaces color count (third field) in header, keeping the rest of it as is.
+std::string replace_color_count(const std::string & header, size_t color_count)
+{
+	size_t pos = 0;
+	for(int field = 0; field < 2; ++field) {
+		pos = header.find_first_not_of(" \t", pos);
+		pos = header.find_first_of(" \t", pos);
+	}
+	size_t begin = header.find_first_not_of(" \t", pos);
+	size_t end = header.find_first_of(" \t", begin);
+	if(begin == std::string::npos) {
+		return header;
+	}
+	char count[32];
+	snprintf(count, sizeof(count), "%u", unsigned(color_count));
+	return header.substr(0, begin) + count + (end == std::string::npos ? std::string() : header.substr(end));
+}
+
+bool write_all(int fd, std::vector<iovec> & iov)
+{
+	size_t first = 0;
+	while(first < iov.size()) {
+		int count = int(std::min<size_t>(iov.size() - first, IOV_MAX));
+		ssize_t written = writev(fd, &iov[first], count);
+		if(written < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		while(first < iov.size() && size_t(written) >= iov[first].iov_len) {
+			written -= iov[first].iov_len;
+			++first;
+		}
+		if(written > 0) {
+			iov[first].iov_base = (char*)iov[first].iov_base + written;
+			iov[first].iov_len -= written;
+		}
+	}
+	return true;
+}
+
+// Writes data into temporary file next to target and renames it over target,
+// so mapped original stays intact while it is being read.
+bool write_file(const std::string & filename, std::vector<iovec> & iov)
+{
+	mode_t mode = 0644;
+	struct stat st;
+	if(stat(filename.c_str(), &st) == 0) {
+		mode = st.st_mode & 0777;
+	}
+	std::string temp_filename = filename + ".tmp";
+	int fd = open(temp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, mode);
+	if(fd < 0) {
+		return false;
+	}
+	bool ok = write_all(fd, iov) && fsync(fd) == 0;
+	ok = (close(fd) == 0) && ok;
+	if(!ok || rename(temp_filename.c_str(), filename.c_str()) != 0) {
+		unlink(temp_filename.c_str());
+		return false;
+	}
+	size_t slash = filename.rfind('/');
+	std::string dirname = (slash == std::string::npos) ? "." : filename.substr(0, slash + 1);
+	int dir = open(dirname.c_str(), O_RDONLY);
+	if(dir >= 0) {
+		fsync(dir);
+		close(dir);
+	}
+	return true;
+}
+
+// Everything that is needed to write file without looking at the canvas.
+struct XpmSaveJob {
+	std::string filename;
+	bool spliced;
+	// Spliced save: pieces of the file described by base_length; base is mapped when job runs if not set.
+	std::shared_ptr<MappedFile> base;
+	size_t base_length;
+	std::vector<XpmPiece> pieces;
+	std::string text;
+	// Full save.
+	Image snapshot;
+	XpmSaveJob() : spliced(false), base_length(0) {}
+};
+
+bool XpmDocument::load(const std::string & filename, Image & image)
+{
+	finishLoading(image);
+	source.reset(new MappedFile);
+	has_layout = source->open(filename) && parse_xpm(source->begin(), source->end(), image, &layout);
+	if(!has_layout) {
+		source.reset();
+		if(!load_xpm(filename, image)) {
+			return false;
+		}
+	}
+	loaded_rows = image.pixels.height();
+	clearChanges(image);
+	return true;
+}
+
+bool XpmDocument::startLoad(const std::string & filename, Image & image)
+{
+	finishLoading(image);
+	has_layout = false;
+	loaded_rows = 0;
+	source.reset(new MappedFile);
+	std::shared_ptr<XpmReader> reader;
+	std::vector<Chthon::Color> palette;
+	if(source->open(filename)) {
+		if(read_xpm_cache(filename, image, layout) && layout.length == source->length()) {
+			has_layout = true;
+			loaded_rows = image.pixels.height();
+			clearChanges(image);
+			return true;
+		}
+		reader.reset(new XpmReader(source->begin(), source->end()));
+	}
+	if(!reader || !reader->readHeader(&palette)) {
+		source.reset();
+		if(!load_xpm(filename, image)) {
+			return false;
+		}
+		loaded_rows = image.pixels.height();
+		clearChanges(image);
+		return true;
+	}
+	std::shared_ptr<XpmCacheWriter> cache(new XpmCacheWriter);
+	cache->open(filename, reader->width(), reader->height(), palette);
+	image.palette.swap(palette);
+	image.pixels = TiledCanvas(reader->width(), reader->height());
+	image.pixels.setColorCount(image.palette.size());
+	clearChanges(image);
+
+	loading = true;
+	load_failed = false;
+	load_done = false;
+	std::shared_ptr<MappedFile> data = source;
+	loader.push([this, reader, data, cache]() { readBands(*reader, *cache); });
+	return true;
+}
+
+const int LOAD_BAND_PIXELS = 1 << 20;
+
+// Runs on loader thread.
+void XpmDocument::readBands(XpmReader & reader, XpmCacheWriter & cache)
+{
+	int width = reader.width();
+	int band_rows = std::max(1, LOAD_BAND_PIXELS / width);
+	while(reader.rowsRead() < reader.height()) {
+		Band band;
+		band.y = reader.rowsRead();
+		band.rows = std::min(band_rows, reader.height() - band.y);
+		band.pixels.resize(band.rows * width);
+		for(int i = 0; i < band.rows; ++i) {
+			if(!reader.readRow(&band.pixels[i * width])) {
+				std::lock_guard<std::mutex> lock(bands_mutex);
+				load_failed = true;
+				return;
+			}
+		}
+		cache.writeRows(band.pixels.data(), band.rows);
+		std::lock_guard<std::mutex> lock(bands_mutex);
+		bands.push_back(Band());
+		bands.back().y = band.y;
+		bands.back().rows = band.rows;
+		bands.back().pixels.swap(band.pixels);
+	}
+	cache.commit(reader.layout());
+	std::lock_guard<std::mutex> lock(bands_mutex);
+	std::swap(loaded_layout, reader.layout());
+	load_done = true;
+}
+
+int XpmDocument::updateLoading(Image & image, int & first_row)
+{
+	first_row = loaded_rows;
+	if(!loading) {
+		return 0;
+	}
+	std::deque<Band> ready;
+	bool failed, done;
+	{
+		std::lock_guard<std::mutex> lock(bands_mutex);
+		ready.swap(bands);
+		failed = load_failed;
+		done = load_done;
+	}
+	int width = image.pixels.width();
+	for(const Band & band : ready) {
+		for(int y = 0; y < band.rows; ++y) {
+			image.pixels.writeSpan(0, band.y + y, width, &band.pixels[y * width]);
+		}
+		loaded_rows = band.y + band.rows;
+	}
+	if(!ready.empty()) {
+		image.pixels.compact();
+	}
+	if(failed) {
+		// Rows that single-pass reader cannot handle: whole file is reloaded through Chthon,
+		// changes made during loading are lost.
+		loader.wait();
+		loading = false;
+		std::shared_ptr<MappedFile> data = source;
+		source.reset();
+		first_row = 0;
+		Chthon::Pixmap pixmap;
+		pixmap.load(std::string(data->begin(), data->end()));
+		image_from_pixmap(pixmap, image);
+		loaded_rows = image.pixels.height();
+		clearChanges(image);
+		return loaded_rows;
+	}
+	if(done) {
+		loader.wait();
+		std::swap(layout, loaded_layout);
+		has_layout = true;
+		loading = false;
+	}
+	return loaded_rows - first_row;
+}
+
+void XpmDocument::finishLoading(Image & image)
+{
+	if(!loading) {
+		return;
+	}
+	loader.wait();
+	int first_row = 0;
+	updateLoading(image, first_row);
+}
+
+// Changes are tracked even without layout, as it may become known after full save finishes.
+void XpmDocument::clearChanges(const Image & image)
+{
+	dirty_rows.assign(image.pixels.height(), false);
+	dirty_colors.assign(image.palette.size(), false);
+}
+
+void XpmDocument::markRows(int y, int count)
+{
+	int begin = std::max(0, y);
+	int end = std::min(int(dirty_rows.size()), y + count);
+	for(int row = begin; row < end; ++row) {
+		dirty_rows[row] = true;
+	}
+}
+
+void XpmDocument::markColor(unsigned index)
+{
+	if(index < dirty_colors.size()) {
+		dirty_colors[index] = true;
+	}
+}
+
+void XpmDocument::markAll()
+{
+	dirty_rows.assign(dirty_rows.size(), true);
+	dirty_colors.assign(dirty_colors.size(), true);
+}
+
+// Collects pieces of new file: ranges of original file and of new text.
+class XpmSplicer {
+public:
+	XpmSplicer(std::vector<XpmPiece> & result_pieces, std::string & result_text)
+		: pieces(result_pieces), text(result_text), pos(0), delta(0) {}
+	void copyUntil(size_t offset);
+	void addText(size_t text_begin);
+	void replace(const XpmSpan & span, size_t text_begin, XpmSpan & new_span);
+	void shift(XpmSpan & span) const;
+	size_t outputOffset() const { return pos + delta; }
+private:
+	std::vector<XpmPiece> & pieces;
+	std::string & text;
+	size_t pos;
+	long delta;
+};
+
+void XpmSplicer::copyUntil(size_t offset)
+{
+	if(offset > pos) {
+		XpmPiece piece = { false, pos, offset - pos };
+		pieces.push_back(piece);
+		pos = offset;
+	}
+}
+
+// Text to add should be already appended to text starting from text_begin.
+void XpmSplicer::addText(size_t text_begin)
+{
+	XpmPiece piece = { true, text_begin, text.size() - text_begin };
+	pieces.push_back(piece);
+	delta += long(piece.length);
+}
+
+void XpmSplicer::replace(const XpmSpan & span, size_t text_begin, XpmSpan & new_span)
+{
+	copyUntil(span.begin);
+	new_span.begin = outputOffset();
+	addText(text_begin);
+	new_span.end = new_span.begin + (text.size() - text_begin);
+	delta -= long(span.end - span.begin);
+	pos = span.end;
+}
+
+void XpmSplicer::shift(XpmSpan & span) const
+{
+	span.begin += delta;
+	span.end += delta;
+}
+
+bool XpmDocument::splice(const Image & image, std::vector<XpmPiece> & pieces, std::string & text, XpmLayout & new_layout) const
+{
+	int cpp = layout.cpp;
+	size_t width = image.pixels.width();
+	if(image.pixels.height() != layout.rows.size() || image.palette.size() < layout.colors.size()) {
+		return false;
+	}
+	if(dirty_rows.size() != layout.rows.size() || dirty_colors.size() < layout.colors.size()) {
+		return false;
+	}
+	if(!layout.rows.empty() && layout.rows[0].end - layout.rows[0].begin != width * cpp) {
+		return false;
+	}
+	new_layout = layout;
+	for(size_t i = layout.colors.size(); i < image.palette.size(); ++i) {
+		std::string code;
+		if(!make_code(new_layout.codes, cpp, code)) {
+			return false;
+		}
+		new_layout.codes += code;
+	}
+
+	XpmSplicer splicer(pieces, text);
+
+	if(image.palette.size() > layout.colors.size()) {
+		size_t text_begin = text.size();
+		new_layout.header_text = replace_color_count(layout.header_text, image.palette.size());
+		text += new_layout.header_text;
+		splicer.replace(layout.header, text_begin, new_layout.header);
+	}
+	for(size_t i = 0; i < layout.colors.size(); ++i) {
+		if(dirty_colors[i]) {
+			size_t text_begin = text.size();
+			text += color_line(new_layout.codes.data() + i * cpp, cpp, image.palette[i]);
+			splicer.replace(layout.colors[i], text_begin, new_layout.colors[i]);
+		} else {
+			splicer.shift(new_layout.colors[i]);
+		}
+	}
+	if(image.palette.size() > layout.colors.size()) {
+		splicer.copyUntil(layout.colors.back().end + 1);
+		size_t text_begin = text.size();
+		for(size_t i = layout.colors.size(); i < image.palette.size(); ++i) {
+			text += ",\n\"";
+			XpmSpan span;
+			span.begin = splicer.outputOffset() + (text.size() - text_begin);
+			text += color_line(new_layout.codes.data() + i * cpp, cpp, image.palette[i]);
+			span.end = splicer.outputOffset() + (text.size() - text_begin);
+			text += "\"";
+			new_layout.colors.push_back(span);
+		}
+		splicer.addText(text_begin);
+	}
+	std::vector<int> row(width);
+	for(size_t y = 0; y < layout.rows.size(); ++y) {
+		if(dirty_rows[y]) {
+			image.pixels.readSpan(0, y, width, row.data());
+			size_t text_begin = text.size();
+			text.resize(text_begin + width * cpp);
+			char * out = &text[text_begin];
+			for(size_t x = 0; x < width; ++x, out += cpp) {
+				unsigned index = row[x];
+				if(index >= image.palette.size()) {
+					return false;
+				}
+				std::copy(new_layout.codes.data() + index * cpp, new_layout.codes.data() + (index + 1) * cpp, out);
+			}
+			splicer.replace(layout.rows[y], text_begin, new_layout.rows[y]);
+		} else {
+			splicer.shift(new_layout.rows[y]);
+		}
+	}
+	splicer.copyUntil(layout.length);
+	new_layout.length = splicer.outputOffset();
+	return true;
+}
+
+void XpmDocument::save(const std::string & filename, const Image & image)
+{
+	std::shared_ptr<XpmSaveJob> job = prepareSave(filename, image);
+	saver.push([this, job]() { runSave(*job); });
+}
+
+bool XpmDocument::saveNow(const std::string & filename, const Image & image)
+{
+	saver.wait();
+	std::shared_ptr<XpmSaveJob> job = prepareSave(filename, image);
+	runSave(*job);
+	return finishSaves();
+}
+
+void XpmDocument::resetLayout()
+{
+	has_layout = false;
+}
+
+std::shared_ptr<XpmSaveJob> XpmDocument::prepareSave(const std::string & filename, const Image & image)
+{
+	std::shared_ptr<XpmSaveJob> job(new XpmSaveJob);
+	job->filename = filename;
+	XpmLayout new_layout;
+	job->spliced = has_layout && splice(image, job->pieces, job->text, new_layout);
+	if(job->spliced) {
+		job->base = source;
+		job->base_length = layout.length;
+		std::swap(layout, new_layout);
+	} else {
+		job->pieces.clear();
+		job->text.clear();
+		job->snapshot = image;
+		has_layout = false;
+	}
+	// Following saves are based on the file written by this one.
+	source.reset();
+	clearChanges(image);
+
+	++pending_saves;
+	return job;
+}
+
+// Runs on saver thread, unless called from saveNow().
+void XpmDocument::runSave(XpmSaveJob & job)
+{
+	SaveResult result;
+	result.ok = false;
+	result.has_layout = false;
+	if(job.spliced && !chain_broken) {
+		if(!job.base) {
+			job.base.reset(new MappedFile);
+			job.base->open(job.filename);
+		}
+		if(job.base->isOpen() && job.base->length() == job.base_length) {
+			std::vector<iovec> iov(job.pieces.size());
+			for(size_t i = 0; i < job.pieces.size(); ++i) {
+				const char * data = job.pieces[i].is_new ? job.text.data() : job.base->begin();
+				iov[i].iov_base = (void*)(data + job.pieces[i].offset);
+				iov[i].iov_len = job.pieces[i].length;
+			}
+			result.ok = write_file(job.filename, iov);
+		}
+	} else if(!job.spliced) {
+		job.text = format_xpm(job.snapshot);
+		std::vector<iovec> iov(1);
+		iov[0].iov_base = (void*)job.text.data();
+		iov[0].iov_len = job.text.size();
+		result.ok = write_file(job.filename, iov);
+		if(result.ok) {
+			result.has_layout = scan_xpm(job.text.data(), job.text.data() + job.text.size(), result.layout);
+		}
+	}
+	job = XpmSaveJob();
+	chain_broken = !result.ok;
+
+	std::lock_guard<std::mutex> lock(results_mutex);
+	results.push_back(result);
+}
+
+bool XpmDocument::finishSaves()
+{
+	std::vector<SaveResult> finished;
+	{
+		std::lock_guard<std::mutex> lock(results_mutex);
+		finished.swap(results);
+	}
+	bool ok = true;
+	for(size_t i = 0; i < finished.size(); ++i) {
+		--pending_saves;
+		if(!finished[i].ok) {
+			// Layout does not match the file anymore, so the next save will be a full one.
+			ok = false;
+			has_layout = false;
+		} else if(finished[i].has_layout && pending_saves == 0 && !has_layout) {
+			std::swap(layout, finished[i].layout);
+			has_layout = true;
+		}
+	}
+	return ok;
+}
+
+bool XpmDocument::waitForSaves()
+{
+	saver.wait();
+	return finishSaves();
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include "mappedfile.h"
+#include "taskqueue.h"
+#include "xpmreader.h"
+#include <deque>
+#include <memory>
+
+// Part of file being saved: either range of original file or range of newly generated text.
+struct XpmPiece {
+	bool is_new;
+	size_t offset, length;
+};
+
+// Whole image in normalized form with the shortest codes that fit its palette.
+std::string format_xpm(const Image & image);
+
+struct XpmSaveJob;
+class XpmCacheWriter;
+
+// Keeps loaded XPM file mapped together with offsets of its header, color table and pixel rows.
+// Save splices only changed rows and colors into original text, so comments and formatting are preserved.
+// Saves are written on background thread in order of requests; document layout is switched to the saved one right away,
+// so next save is spliced against result of previous one.
+class XpmDocument {
+public:
+	XpmDocument() : has_layout(false), pending_saves(0), chain_broken(false), loading(false), loaded_rows(0), load_failed(false), load_done(false) {}
+	// Both loads return false and leave image intact if file cannot be read.
+	bool load(const std::string & filename, Image & image);
+	// Reads header and palette right away and parses pixel rows on background thread.
+	// Rows appear in image only through updateLoading(); image must not be saved until loading is finished.
+	// Files that cannot be read progressively are loaded synchronously.
+	// Up-to-date binary cache is used instead of parsing when there is one, otherwise it is written while rows are parsed.
+	bool startLoad(const std::string & filename, Image & image);
+	// Copies rows parsed so far into image and returns their count, first_row is set to the first of them.
+	int updateLoading(Image & image, int & first_row);
+	void finishLoading(Image & image);
+	bool isLoading() const { return loading; }
+	int loadedRows() const { return loaded_rows; }
+	void save(const std::string & filename, const Image & image);
+	// Saves on the calling thread after all queued saves.
+	bool saveNow(const std::string & filename, const Image & image);
+	// Next save writes whole file in normalized form instead of changing original text.
+	void resetLayout();
+	// Applies results of finished saves. Returns false if any of them has failed.
+	bool finishSaves();
+	bool waitForSaves();
+	bool isSaving() const { return pending_saves > 0; }
+	void markRows(int y, int count = 1);
+	void markColor(unsigned index);
+	void markAll();
+private:
+	struct Band {
+		int y, rows;
+		std::vector<int> pixels;
+	};
+	struct SaveResult {
+		bool ok;
+		bool has_layout;
+		XpmLayout layout;
+	};
+	std::shared_ptr<MappedFile> source;
+	XpmLayout layout;
+	bool has_layout;
+	std::vector<bool> dirty_rows;
+	std::vector<bool> dirty_colors;
+	int pending_saves;
+	std::mutex results_mutex;
+	std::vector<SaveResult> results;
+	bool chain_broken; // Accessed only from saver thread.
+	TaskQueue saver;
+	bool loading;
+	int loaded_rows;
+	std::mutex bands_mutex;
+	std::deque<Band> bands;
+	bool load_failed, load_done;
+	XpmLayout loaded_layout;
+	TaskQueue loader;
+
+	bool splice(const Image & image, std::vector<XpmPiece> & pieces, std::string & text, XpmLayout & new_layout) const;
+	void clearChanges(const Image & image);
+	std::shared_ptr<XpmSaveJob> prepareSave(const std::string & filename, const Image & image);
+	void runSave(XpmSaveJob & job);
+	void readBands(XpmReader & reader, XpmCacheWriter & cache);
+};
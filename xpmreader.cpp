@@ -0,0 +1,196 @@
+#include "xpmreader.h"
+#include "mappedfile.h"
+#include "codetable.h"
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+const int MAX_CHARS_PER_PIXEL = 8;
+
+// Finds next quoted string starting from pos, skipping C comments and everything else outside of quotes.
+bool next_xpm_string(const char *& pos, const char * end, const char *& str, const char *& str_end)
+{
+	while(pos < end) {
+		if(*pos == '"') {
+			const char * close = (const char*)memchr(pos + 1, '"', end - pos - 1);
+			if(!close) {
+				return false;
+			}
+			str = pos + 1;
+			str_end = close;
+			pos = close + 1;
+			return true;
+		}
+		if(*pos == '/' && pos + 1 < end && pos[1] == '*') {
+			pos += 2;
+			while(pos + 1 < end && !(pos[0] == '*' && pos[1] == '/')) {
+				++pos;
+			}
+			pos += 2;
+			continue;
+		}
+		++pos;
+	}
+	return false;
+}
+
+XpmSpan make_span(const char * begin, const char * str, const char * str_end)
+{
+	XpmSpan span;
+	span.begin = str - begin;
+	span.end = str_end - begin;
+	return span;
+}
+
+XpmReader::XpmReader(const char * data_begin, const char * data_end)
+	: begin(data_begin), end(data_end), pos(data_begin), image_width(0), image_height(0), rows_read(0)
+{
+}
+
+XpmReader::~XpmReader()
+{
+}
+
+bool XpmReader::readHeader(std::vector<Chthon::Color> * palette)
+{
+	const char * str = 0;
+	const char * str_end = 0;
+	if(!next_xpm_string(pos, end, str, str_end)) {
+		return false;
+	}
+	result.length = end - begin;
+	result.header = make_span(begin, str, str_end);
+	result.header_text.assign(str, str_end);
+	int color_count = 0, cpp = 0;
+	std::istringstream header(result.header_text);
+	header >> image_width >> image_height >> color_count >> cpp;
+	if(!header || image_width <= 0 || image_height <= 0 || color_count <= 0 || cpp <= 0 || cpp > MAX_CHARS_PER_PIXEL) {
+		return false;
+	}
+	std::string extra;
+	while(header >> extra) {
+		if(extra == "XPMEXT") {
+			return false;
+		}
+	}
+	result.cpp = cpp;
+
+	// Color specs are few, so they are decoded by Chthon itself
+	// through a 1x1 image with the same color table to keep color parsing identical.
+	std::vector<std::string> color_table;
+	color_table.reserve(color_count + 2);
+	std::ostringstream table_header;
+	table_header << "1 1 " << color_count << ' ' << cpp;
+	color_table.push_back(table_header.str());
+	codes.reset(new CodeTable(cpp));
+	for(int i = 0; i < color_count; ++i) {
+		if(!next_xpm_string(pos, end, str, str_end) || str_end - str < cpp) {
+			return false;
+		}
+		if(!codes->add(str, i)) {
+			return false;
+		}
+		result.colors.push_back(make_span(begin, str, str_end));
+		result.codes.append(str, cpp);
+		color_table.push_back(std::string(str, str_end));
+	}
+	color_table.push_back(color_table[1].substr(0, cpp));
+	if(palette) {
+		Chthon::Pixmap colors;
+		try {
+			colors.load(color_table);
+		} catch(const Chthon::Pixmap::Exception &) {
+			return false;
+		}
+		if(colors.palette.size() != size_t(color_count)) {
+			return false;
+		}
+		palette->swap(colors.palette);
+	}
+	result.rows.reserve(image_height);
+	return true;
+}
+
+bool XpmReader::readRow(int * values)
+{
+	const char * str = 0;
+	const char * str_end = 0;
+	int cpp = result.cpp;
+	if(rows_read >= image_height || !next_xpm_string(pos, end, str, str_end) || str_end - str != image_width * cpp) {
+		return false;
+	}
+	result.rows.push_back(make_span(begin, str, str_end));
+	++rows_read;
+	return !values || codes->decode(str, image_width, values);
+}
+
+// Reads whole image in one pass.
+// Pixels are decoded only when image is given, layout is recorded only when layout is given.
+bool read_xpm(const char * begin, const char * end, Image * image, XpmLayout * layout)
+{
+	XpmReader reader(begin, end);
+	std::vector<Chthon::Color> palette;
+	if(!reader.readHeader(image ? &palette : 0)) {
+		return false;
+	}
+	TiledCanvas pixels(image ? reader.width() : 1, image ? reader.height() : 1);
+	pixels.setColorCount(palette.size());
+	std::vector<int> row(reader.width());
+	for(int y = 0; y < reader.height(); ++y) {
+		if(!reader.readRow(image ? &row[0] : 0)) {
+			return false;
+		}
+		if(!image) {
+			continue;
+		}
+		pixels.writeSpan(0, y, reader.width(), row.data());
+		if(y % TiledCanvas::TILE_SIZE == TiledCanvas::TILE_SIZE - 1) {
+			pixels.compact();
+		}
+	}
+
+	if(image) {
+		pixels.compact();
+		std::swap(image->palette, palette);
+		std::swap(image->pixels, pixels);
+	}
+	if(layout) {
+		std::swap(*layout, reader.layout());
+	}
+	return true;
+}
+
+bool parse_xpm(const char * begin, const char * end, Image & image, XpmLayout * layout)
+{
+	return read_xpm(begin, end, &image, layout);
+}
+
+bool scan_xpm(const char * begin, const char * end, XpmLayout & layout)
+{
+	return read_xpm(begin, end, 0, &layout);
+}
+
+bool load_xpm(const std::string & filename, Image & image)
+{
+	Chthon::Pixmap pixmap;
+	MappedFile file;
+	if(file.open(filename)) {
+		if(!parse_xpm(file.begin(), file.end(), image)) {
+			pixmap.load(std::string(file.begin(), file.end()));
+			image_from_pixmap(pixmap, image);
+		}
+		return true;
+	}
+	std::ifstream stream(filename.c_str());
+	if(!stream) {
+		return false;
+	}
+	std::string data((std::istreambuf_iterator<char>(stream)),
+			std::istreambuf_iterator<char>());
+	if(stream.bad()) {
+		return false;
+	}
+	pixmap.load(data);
+	image_from_pixmap(pixmap, image);
+	return true;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "image.h"
+#include <chthon2/pixmap.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+class CodeTable;
+
+// Byte offsets of string contents (without quotes) within XPM data.
+struct XpmSpan {
+	size_t begin, end;
+};
+
+struct XpmLayout {
+	int cpp;
+	size_t length;
+	XpmSpan header;
+	std::string header_text;
+	std::vector<XpmSpan> colors;
+	std::vector<XpmSpan> rows;
+	std::string codes; // cpp chars per palette entry.
+	XpmLayout() : cpp(0), length(0) { header.begin = header.end = 0; }
+};
+
+// Reads XPM data step by step: header with color table first, then pixel rows one after another.
+// Layout is recorded as data is read.
+class XpmReader {
+public:
+	XpmReader(const char * data_begin, const char * data_end);
+	~XpmReader();
+	// Colors are decoded into palette only when it is given.
+	bool readHeader(std::vector<Chthon::Color> * palette);
+	// Decodes next row into values (width() items); when values is null row is only checked.
+	bool readRow(int * values);
+	int width() const { return image_width; }
+	int height() const { return image_height; }
+	int rowsRead() const { return rows_read; }
+	XpmLayout & layout() { return result; }
+private:
+	const char * begin;
+	const char * end;
+	const char * pos;
+	int image_width, image_height;
+	int rows_read;
+	XpmLayout result;
+	std::unique_ptr<CodeTable> codes;
+
+	XpmReader(const XpmReader &);
+	XpmReader & operator=(const XpmReader &);
+};
+
+// Parses XPM data in one pass straight into image.
+// Returns false without touching image if data uses features that are left to Chthon::Pixmap::load (extensions, codes wider than 8 chars, malformed rows).
+// Offsets of header, color table and rows are stored in layout when it is given.
+bool parse_xpm(const char * begin, const char * end, Image & image, XpmLayout * layout = 0);
+
+// Same as parse_xpm but only collects layout without decoding pixels.
+bool scan_xpm(const char * begin, const char * end, XpmLayout & layout);
+
+// Loads file through mmap and parse_xpm, falling back to Chthon::Pixmap::load.
+// Throws Chthon::Pixmap::Exception on invalid data; returns false without touching image if file cannot be read.
+bool load_xpm(const std::string & filename, Image & image);